@@ -156,6 +156,9 @@ void adc_interrupt(void)
   if (isr & ADC_ISR_AWD) {
     /* Analog watchdog error.*/
     handle_touch_interrupt();
+    chSysLockFromISR();
+    wakeup_sweep_threadI();
+    chSysUnlockFromISR();
   }
 }
 
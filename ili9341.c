@@ -436,10 +436,24 @@ void ili9341_bulk(int x, int y, int w, int h)
 {
   ili9341_setWindow(x, y ,w, h);
   send_command(ILI9341_MEMORY_WRITE, 0, NULL);
+  uint16_t *buf = spi_buffer;
   int32_t len = w * h;
   while (len-- > 0)
     spi_TxWord(*buf++);
 }
+
+void ili9341_bulk_continue(int x, int y, int w, int h, uint16_t *buffer)
+{
+  ili9341_setWindow(x, y ,w, h);
+  send_command(ILI9341_MEMORY_WRITE, 0, NULL);
+  int32_t len = w * h;
+  while (len-- > 0)
+    spi_TxWord(*buffer++);
+}
+
+void ili9341_bulk_finish(void)
+{
+}
 #else
 //
 // Use DMA for send data
@@ -482,7 +496,51 @@ void ili9341_bulk(int x, int y, int w, int h)
   }
 #endif
 }
+
+// Start sending a cell buffer to region and return without waiting, the
+// previous cell transfer is completed first so its buffer can be reused
+void ili9341_bulk_continue(int x, int y, int w, int h, uint16_t *buffer)
+{
+  dmaWaitCompletion(dmatx);
+  ili9341_setWindow(x, y ,w, h);
+  send_command(ILI9341_MEMORY_WRITE, 0, NULL);
+
+  // Init Tx DMA mem->spi, set size, mode (spi and mem data size is 16 bit), cell size < 65535
+  dmaStreamSetMemory0(dmatx, buffer);
+  dmaStreamSetMode(dmatx, txdmamode | STM32_DMA_CR_PSIZE_HWORD |
+                              STM32_DMA_CR_MSIZE_HWORD | STM32_DMA_CR_MINC);
+  dmaStreamSetTransactionSize(dmatx, w * h);
+  dmaStreamEnable(dmatx);
+#if DISPLAY_CELL_BUFFER_COUNT == 1
+  dmaWaitCompletion(dmatx);
+#endif
+#ifdef __REMOTE_DESKTOP__
+  if (auto_capture) {
+     send_region("bulk", x,y,w,h);
+     send_buffer((uint8_t *)buffer, w*h*2);
+     osalThreadSleepMilliseconds(2);
+  }
 #endif
+}
+
+// Wait last cell transfer, must be called before any other LCD or spi_buffer access
+void ili9341_bulk_finish(void)
+{
+  dmaWaitCompletion(dmatx);
+}
+#endif
+
+// Cells rotate through the render buffers in spi_buffer, one is rendered
+// while ili9341_bulk_continue() sends the other
+uint16_t *ili9341_get_cell_buffer(void)
+{
+#if DISPLAY_CELL_BUFFER_COUNT == 1
+  return spi_buffer;
+#else
+  static uint8_t cell_idx = 0;
+  return &spi_buffer[((cell_idx++) % DISPLAY_CELL_BUFFER_COUNT) * (CELLWIDTH*CELLHEIGHT)];
+#endif
+}
 
 #ifndef __USE_DISPLAY_DMA_RX__
 
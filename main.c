@@ -57,9 +57,12 @@ static BaseSequentialStream *shell_stream;
 // Shell command promt
 #define VNA_SHELL_PROMPT_STR     "ch> "
 // Shell max arguments
-#define VNA_SHELL_MAX_ARGUMENTS   4
-// Shell max command line size
-#define VNA_SHELL_MAX_LENGTH     48
+#define VNA_SHELL_MAX_ARGUMENTS   5
+// Shell max command line size, room for a ';' separated batch in machine mode
+#define VNA_SHELL_MAX_LENGTH     128
+// Machine mode: no echo and prompt, ';' separated commands, each answered with a status code line
+static uint8_t shell_machine = false;
+enum {SHELL_OK, SHELL_UNKNOWN, SHELL_TOO_MANY_ARGS};
 
 // Shell command functions prototypes
 typedef void (*vna_shellcmd_t)(int argc, char *argv[]);
@@ -71,6 +74,15 @@ static char shell_line[VNA_SHELL_MAX_LENGTH];
 static char *shell_args[VNA_SHELL_MAX_ARGUMENTS + 1];
 static uint16_t shell_nargs;
 static volatile vna_shellcmd_t  shell_function = 0;
+static thread_reference_t shell_waiting = NULL;     // Shell thread sleeping till sweep thread has run shell_function
+static thread_reference_t sweep_waiting = NULL;     // Sweep thread idle, sleeping till there is something to do
+#define SWEEP_IDLE_TIMEOUT  TIME_MS2I(20)           // Also wake up to poll button release and redraw
+static volatile uint8_t settings_staged = false;     // Sweep held at boundary while shell edits settings, till commit
+static systime_t settings_staged_time;               // Last shell command while staged
+#define STAGE_TIMEOUT       TIME_MS2I(5000)          // Staged settings are applied when the host goes quiet or away
+static void stage_release(void);
+static void shell_out_begin(void);
+static void shell_out_end(void);
 
 //#define ENABLED_DUMP
 // Allow get threads debug info
@@ -94,6 +106,14 @@ static void cal_interpolate(int s);
 void update_frequencies(void);
 static void set_frequencies(freq_t start, freq_t stop, uint16_t points);
 static bool sweep(bool break_on_operation);
+#ifdef __SWEEP_STREAM__
+static uint8_t sweep_stream = false;
+static void sweep_stream_push(void);
+#endif
+#ifdef __SCAN_JOBS__
+static bool scan_job_ready(void);
+static void scan_job_run(void);
+#endif
 #ifdef __VNA__
 static void transform_domain(void);
 
@@ -128,6 +148,19 @@ uint16_t dirty = true;
 
 bool completed = false;
 
+#ifdef __HEADLESS__
+// Average time of completed sweeps and of the whole sweep cycle (sweep, draw, UI and shell)
+// in system ticks * 8, index 0 with screen updates, 1 headless
+static uint32_t sweep_ticks[2];
+static uint32_t cycle_ticks[2];
+
+static void sweep_ticks_average(uint32_t *avg, systime_t t)
+{
+  t <<= 3;
+  *avg = *avg ? *avg + ((int32_t)(t - *avg) >> 3) : t;
+}
+#endif
+
 static THD_WORKING_AREA(waThread1, 768);
 static THD_FUNCTION(Thread1, arg)
 {
@@ -137,11 +170,37 @@ static THD_FUNCTION(Thread1, arg)
   ui_process();
 
   while (1) {
+    if (settings_staged && chVTGetSystemTimeX() - settings_staged_time > STAGE_TIMEOUT)
+      stage_release();                                  // No commit from the host, do not hold the sweep forever
+#ifdef __HEADLESS__
+    systime_t sweep_start = chVTGetSystemTimeX();
+    bool swept = false;
+#endif
 //  START_PROFILE
-    if (sweep_mode&(SWEEP_ENABLE|SWEEP_ONCE)) {
+#ifdef __SCAN_JOBS__
+    if (!settings_staged && scan_job_ready()) {
+      // Queued jobs run back to back ahead of the normal sweep, also when paused
+      scan_job_run();
+    } else
+#endif
+    if (!settings_staged && (sweep_mode&(SWEEP_ENABLE|SWEEP_ONCE))) {
 //      if (dirty)
         completed = sweep(true);
       sweep_mode&=~SWEEP_ONCE;
+#ifdef __HEADLESS__
+      if (completed) {
+        sweep_ticks_average(&sweep_ticks[HEADLESS()], chVTGetSystemTimeX() - sweep_start);
+        swept = true;
+      }
+#endif
+#ifdef __SWEEP_HISTORY__
+      if (completed && MODE_INPUT(setting.mode))
+        sweep_history_push();
+#endif
+#ifdef __SWEEP_STREAM__
+      if (completed && sweep_stream)
+        sweep_stream_push();
+#endif
     } else if (sweep_mode & SWEEP_SELFTEST) {
       // call from lowest level to save stack space
       self_test(setting.test);
@@ -155,16 +214,24 @@ static THD_FUNCTION(Thread1, arg)
       calibrate();
       sweep_mode = SWEEP_ENABLE;
     } else {
-//      if (setting.mode != -1)
-        __WFI();
+      // Sleep till lever, touch or shell wakes us (or timeout), no wait for unrelated interrupts as with __WFI()
+      chSysLock();
+      if (!shell_function && !operation_requested)
+        chThdSuspendTimeoutS(&sweep_waiting, SWEEP_IDLE_TIMEOUT);
+      chSysUnlock();
     }
 //  STOP_PROFILE
     // Run Shell command in sweep thread
     if (shell_function) {
       operation_requested = OP_NONE; // otherwise commands  will be aborted
+      shell_out_begin();
       shell_function(shell_nargs - 1, &shell_args[1]);
+      shell_out_end();
+      // Wake shell thread, it has higher priority so it replies before sweep continues
+      chSysLock();
       shell_function = 0;
-      osalThreadSleepMilliseconds(10);
+      chThdResumeS(&shell_waiting, MSG_OK);
+      chSysUnlock();
       if (dirty) {
         if (MODE_OUTPUT(setting.mode))
           draw_menu();    // update screen if in output mode and dirty
@@ -184,8 +251,14 @@ static THD_FUNCTION(Thread1, arg)
       if ((domain_mode & DOMAIN_MODE) == DOMAIN_TIME) transform_domain();
 #endif	  
       // Prepare draw graphics, cache all lines, mark screen cells for redraw
-      plot_into_index(measured);
-      redraw_request |= REDRAW_CELLS | REDRAW_BATTERY;
+      if (!HEADLESS()) {
+        plot_into_index(measured);
+        redraw_request |= REDRAW_CELLS | REDRAW_BATTERY;
+      }
+#ifdef __HEADLESS__
+      else if (uistat.marker_tracking)
+        plot_into_actual_index(measured);
+#endif
 
       if (uistat.marker_tracking) {
         int i = marker_search();
@@ -198,8 +271,15 @@ static THD_FUNCTION(Thread1, arg)
       }
     }
     // plot trace and other indications as raster
-    draw_all(completed);  // flush markmap only if scan completed to prevent
-                          // remaining traces
+    if (!HEADLESS())
+      draw_all(completed);  // flush markmap only if scan completed to prevent
+                            // remaining traces
+    else
+      redraw_request = 0;
+#ifdef __HEADLESS__
+    if (swept)
+      sweep_ticks_average(&cycle_ticks[HEADLESS()], chVTGetSystemTimeX() - sweep_start);
+#endif
 //    STOP_PROFILE
   }
 
@@ -215,6 +295,19 @@ is_paused(void)
   return !(sweep_mode & SWEEP_ENABLE);
 }
 
+int
+is_staged(void)
+{
+  return settings_staged;
+}
+
+// Wake idle sweep thread from interrupt (lever, touch)
+void
+wakeup_sweep_threadI(void)
+{
+  chThdResumeI(&sweep_waiting, MSG_OK);
+}
+
 static inline void
 pause_sweep(void)
 {
@@ -331,6 +424,94 @@ transform_domain(void)
 }
 #endif
 
+//
+// Shell output stream, collects the output of a command into whole USB packets
+// Only the thread running the command buffers, output of other threads passes straight through
+//
+#define SHELL_OUT_SIZE  64                  // USB CDC bulk packet size
+
+struct shellOutVMT {
+  _base_sequential_stream_methods
+};
+
+typedef struct {
+  const struct shellOutVMT *vmt;
+  BaseSequentialStream *target;             // SDU1 or SD1
+  thread_t *owner;                          // Thread running a command, NULL if not buffering
+  uint16_t len;
+  uint8_t  buf[SHELL_OUT_SIZE];
+} shellOut;
+
+static shellOut shell_out;
+static uint32_t shell_out_bytes = 0;
+static uint32_t shell_out_packets = 0;
+
+static void shell_out_flush(void)
+{
+  if (shell_out.len == 0)
+    return;
+  streamWrite(shell_out.target, shell_out.buf, shell_out.len);
+  shell_out_bytes += shell_out.len;
+  shell_out_packets++;
+  shell_out.len = 0;
+}
+
+static size_t shell_out_write(void *ip, const uint8_t *bp, size_t n)
+{
+  shellOut *so = ip;
+  if (so->owner != chThdGetSelfX() || n >= SHELL_OUT_SIZE) {      // Not buffering or already a full packet
+    if (so->owner == chThdGetSelfX())
+      shell_out_flush();
+    shell_out_bytes += n;
+    shell_out_packets += (n + SHELL_OUT_SIZE - 1) / SHELL_OUT_SIZE;
+    return streamWrite(so->target, bp, n);
+  }
+  for (size_t i = 0; i < n; i++) {
+    so->buf[so->len++] = bp[i];
+    if (so->len == SHELL_OUT_SIZE)
+      shell_out_flush();
+  }
+  return n;
+}
+
+static msg_t shell_out_put(void *ip, uint8_t b)
+{
+  shell_out_write(ip, &b, 1);
+  return MSG_OK;
+}
+
+static size_t shell_out_read(void *ip, uint8_t *bp, size_t n)
+{
+  return streamRead(((shellOut *)ip)->target, bp, n);
+}
+
+static msg_t shell_out_get(void *ip)
+{
+  return streamGet(((shellOut *)ip)->target);
+}
+
+static const struct shellOutVMT shell_out_vmt = {shell_out_write, shell_out_read, shell_out_put, shell_out_get};
+
+static void shell_out_init(BaseSequentialStream *target)
+{
+  shell_out.vmt = &shell_out_vmt;
+  shell_out.target = target;
+  shell_stream = (BaseSequentialStream *)(void *)&shell_out;
+}
+
+// Start buffering output of calling thread
+static void shell_out_begin(void)
+{
+  shell_out.owner = chThdGetSelfX();
+}
+
+// Send remaining output and stop buffering
+static void shell_out_end(void)
+{
+  shell_out_flush();
+  shell_out.owner = NULL;
+}
+
 // Shell commands output
 int shell_printf(const char *fmt, ...)
 {
@@ -770,6 +951,57 @@ static const I2SConfig i2sconfig = {
 #endif
 #endif
 
+//
+// Fast trace dump formatting, avoids the float printf path for every point
+//
+#define LEVEL_DECIMALS  3
+
+// Unsigned integer to text, u in 1/10^decimals units
+static char *ufixed_to_string(char *p, uint32_t u, int decimals)
+{
+  char tmp[12];
+  char *q = tmp + sizeof tmp;
+  int n = 0;
+  do {
+    *--q = '0' + u % 10;
+    u /= 10;
+    if (++n == decimals)
+      *--q = '.';
+  } while (u || n <= decimals);
+  while (q < tmp + sizeof tmp)
+    *p++ = *q++;
+  return p;
+}
+
+static char *fixed_to_string(char *p, int32_t v, int decimals)
+{
+  if (v < 0) {
+    *p++ = '-';
+    v = -v;
+  }
+  return ufixed_to_string(p, v, decimals);
+}
+
+// Level in dB to 1/1000dB through 1/512dB fixed point, which holds every level the sweep stores exactly
+static int32_t level_to_milli(float v)
+{
+  int32_t fine = v * 512;
+  return (fine * 125 + (fine < 0 ? -32 : 32)) / 64;
+}
+
+// Trace value in the selected unit, log units (dBm, dBmV, dBuV) only differ by an offset
+static char *trace_value_to_string(char *p, float v, int32_t unit_offset)
+{
+  if (UNIT_IS_LINEAR(setting.unit))          // Needs pow() anyway
+    return p + plot_printf(p, 24, "%f", value(v));
+  return fixed_to_string(p, level_to_milli(v) + unit_offset, LEVEL_DECIMALS);
+}
+
+static int32_t trace_unit_offset(void)
+{
+  return UNIT_IS_LINEAR(setting.unit) ? 0 : level_to_milli(value(0.0));
+}
+
 #define MAX_DATA    2
 VNA_SHELL_FUNCTION(cmd_data)
 {
@@ -780,8 +1012,13 @@ VNA_SHELL_FUNCTION(cmd_data)
 
 
   if (sel >= 0 && sel <= MAX_DATA) {
-    for (i = 0; i < sweep_points; i++)
-      shell_printf("%f\r\n", value(measured[sel][i]));
+    int32_t unit_offset = trace_unit_offset();
+    char buf[26];
+    for (i = 0; i < sweep_points; i++) {
+      char *p = trace_value_to_string(buf, measured[sel][i], unit_offset);
+      *p++ = '\r'; *p++ = '\n';
+      streamWrite(shell_stream, (uint8_t *)buf, p - buf);
+    }
     return;
   }
   shell_printf("usage: data [0-2]\r\n");
@@ -1125,12 +1362,20 @@ VNA_SHELL_FUNCTION(cmd_scan)
   if (argc == 4) {
     uint16_t mask = my_atoui(argv[3]);
     if (mask) {
+      int32_t unit_offset = trace_unit_offset();
+      char buf[12 + 3 * 32 + 2];
       for (i = 0; i < points; i++) {
-        if (mask & 1) shell_printf("%u ", frequencies[i]);
-        if (mask & 2) shell_printf("%f %f ", value(measured[2][i]), 0.0);
-        if (mask & 4) shell_printf("%f %f ", value(measured[1][i]), 0.0);
-        if (mask & 8) shell_printf("%f %f ", value(measured[0][i]), 0.0);
-        shell_printf("\r\n");
+        char *p = buf;
+        if (mask & 1) { p = ufixed_to_string(p, frequencies[i], 0); *p++ = ' '; }
+        for (int t = 2; t >= 0; t--) {
+          if (mask & (1 << (3 - t))) {
+            p = trace_value_to_string(p, measured[t][i], unit_offset);
+            memcpy(p, " 0.000 ", 7);
+            p += 7;
+          }
+        }
+        *p++ = '\r'; *p++ = '\n';
+        streamWrite(shell_stream, (uint8_t *)buf, p - buf);
       }
     }
   }
@@ -1203,7 +1448,7 @@ set_frequencies(freq_t start, freq_t stop, uint16_t points)
   for (; i < POINTS_COUNT; i++)
     frequencies[i] = 0;
   setting.frequency_step = delta;
-  dirty = true;
+  dirty |= DIRTY_LO;
 }
 
 void
@@ -2349,7 +2594,7 @@ VNA_SHELL_FUNCTION(cmd_threads)
   do {
     uint32_t max_stack_use = 0U;
 #if (CH_DBG_ENABLE_STACK_CHECK == TRUE) || (CH_CFG_USE_DYNAMIC == TRUE)
-    uint32_t stklimit = (uint32_t)tp->wabase;
+    uint32_t stklimit = (uint32_t)(uintptr_t)tp->wabase;
 #if CH_DBG_FILL_THREADS == TRUE
     uint8_t *p = (uint8_t *)tp->wabase; while(p[max_stack_use]==CH_DBG_STACK_FILL_VALUE) max_stack_use++;
 #endif
@@ -2357,7 +2602,7 @@ VNA_SHELL_FUNCTION(cmd_threads)
     uint32_t stklimit = 0U;
 #endif
     shell_printf("%08x|%08x|%08x|%08x|%4u|%4u|%9s|%12s"VNA_SHELL_NEWLINE_STR,
-             stklimit, (uint32_t)tp->ctx.sp, max_stack_use, (uint32_t)tp,
+             stklimit, (uint32_t)(uintptr_t)tp->ctx.sp, max_stack_use, (uint32_t)(uintptr_t)tp,
              (uint32_t)tp->refs - 1, (uint32_t)tp->prio, states[tp->state],
              tp->name == NULL ? "" : tp->name);
     tp = chRegNextThread(tp);
@@ -2383,6 +2628,10 @@ VNA_SHELL_FUNCTION(cmd_usart)
 
 //=============================================================================
 VNA_SHELL_FUNCTION(cmd_help);
+VNA_SHELL_FUNCTION(cmd_machine);
+VNA_SHELL_FUNCTION(cmd_txstat);
+VNA_SHELL_FUNCTION(cmd_stage);
+VNA_SHELL_FUNCTION(cmd_commit);
 
 #pragma pack(push, 2)
 typedef struct {
@@ -2393,6 +2642,7 @@ typedef struct {
 #pragma pack(pop)
 
 // Some commands can executed only in sweep thread, not in main cycle
+// Read only commands (data, marker, frequencies, stat) run at once in shell thread, may see a sweep in progress
 #define CMD_WAIT_MUTEX  1
 static const VNAShellCommand commands[] =
 {
@@ -2409,7 +2659,7 @@ static const VNAShellCommand commands[] =
     {"sweep_voltage",cmd_sweep_voltage,0},
     {"saveconfig"  , cmd_saveconfig  , 0},
     {"clearconfig" , cmd_clearconfig , 0},
-    {"data"        , cmd_data        , CMD_WAIT_MUTEX},
+    {"data"        , cmd_data        , 0},
 #ifdef ENABLED_DUMP
     {"dump"        , cmd_dump        , 0},
 #endif
@@ -2460,6 +2710,10 @@ static const VNAShellCommand commands[] =
     {"threshold"   , cmd_threshold   , 0},
 #endif
     {"help"        , cmd_help        , 0},
+    {"machine"     , cmd_machine     , 0},
+    {"stage"       , cmd_stage       , CMD_WAIT_MUTEX},
+    {"commit"      , cmd_commit      , CMD_WAIT_MUTEX},
+    {"txstat"      , cmd_txstat      , 0},
 #ifdef ENABLE_INFO_COMMAND
     {"info"        , cmd_info        , 0},
 #endif
@@ -2482,6 +2736,31 @@ static const VNAShellCommand commands[] =
     { "deviceid", cmd_deviceid,    0 },
     { "selftest", cmd_selftest,    0 },
     { "correction", cmd_correction,    0 },
+#ifdef __BENCH__
+    { "bench", cmd_bench,    CMD_WAIT_MUTEX },
+#endif
+#ifdef __ADAPTIVE_SETTLE__
+    { "settle", cmd_settle,    0 },
+#endif
+#ifdef __REFINE_SWEEP__
+    { "refine", cmd_refine,    0 },
+#endif
+#ifdef __SWEEP_STREAM__
+    { "stream", cmd_stream,    CMD_WAIT_MUTEX },
+#endif
+#ifdef __SCAN_JOBS__
+    { "job", cmd_job,    CMD_WAIT_MUTEX },
+#endif
+#ifdef __SWEEP_HISTORY__
+    { "history", cmd_history,    CMD_WAIT_MUTEX },
+#endif
+#ifdef __HEADLESS__
+    { "headless", cmd_headless,    CMD_WAIT_MUTEX },
+    { "stat", cmd_stat,    0 },
+#endif
+#ifdef __SI4432_BUS_MOCK__
+    { "bus", cmd_bus,    0 },
+#endif
  #ifdef ENABLE_THREADS_COMMAND
      {"threads"     , cmd_threads     , 0},
  #endif
@@ -2510,6 +2789,54 @@ static const VNAShellCommand commands[] =
     {NULL          , NULL            , 0}
 };
 
+VNA_SHELL_FUNCTION(cmd_txstat)
+{
+  (void)argv;
+  if (argc == 0) {
+    shell_printf("bytes %u packets %u" VNA_SHELL_NEWLINE_STR, shell_out_bytes, shell_out_packets);
+    return;
+  }
+  shell_out_bytes = shell_out_packets = 0;
+}
+
+VNA_SHELL_FUNCTION(cmd_machine)
+{
+  if (argc == 0) {
+    shell_printf("%s" VNA_SHELL_NEWLINE_STR, shell_machine ? "on" : "off");
+    return;
+  }
+  int m = generic_option_cmd("machine", "off|on", argc, argv[0]);
+  if (m >= 0)
+    shell_machine = m;
+}
+
+// Settings commands after stage only edit settings, the sweep stays at the sweep boundary
+// and restarts once with all of them on commit. A machine mode batch is staged implicitly.
+// Without commit the staged settings are applied after STAGE_TIMEOUT or when the USB session ends.
+VNA_SHELL_FUNCTION(cmd_stage)
+{
+  (void)argc;
+  (void)argv;
+  settings_staged_time = chVTGetSystemTimeX();
+  settings_staged = true;
+  redraw_request |= REDRAW_CAL_STATUS;
+}
+
+static void stage_release(void)
+{
+  settings_staged = false;
+  dirty = true;
+  redraw_request |= REDRAW_CAL_STATUS;
+}
+
+VNA_SHELL_FUNCTION(cmd_commit)
+{
+  (void)argc;
+  (void)argv;
+  if (settings_staged)
+    stage_release();
+}
+
 VNA_SHELL_FUNCTION(cmd_help)
 {
   (void)argc;
@@ -2538,7 +2865,7 @@ VNA_SHELL_FUNCTION(cmd_help)
 #endif
 
 // Before start process command from shell, need select input stream
-#define PREPARE_STREAM shell_stream = (config._mode&_MODE_SERIAL) ? (BaseSequentialStream *)&SD1 : (BaseSequentialStream *)&SDU1;
+#define PREPARE_STREAM shell_out_init((config._mode&_MODE_SERIAL) ? (BaseSequentialStream *)&SD1 : (BaseSequentialStream *)&SDU1);
 
 // Update Serial connection speed and settings
 void shell_update_speed(void){
@@ -2634,7 +2961,7 @@ static void shell_init_connection(void){
 /*
  *  Set I/O stream SDU1 for shell
  */
-  shell_stream = (BaseSequentialStream *)&SDU1;
+  shell_out_init((BaseSequentialStream *)&SDU1);
 }
 #endif
 
@@ -2656,14 +2983,16 @@ static int VNAShell_readLine(char *line, int max_size)
     if (c == 8 || c == 0x7f) {
       if (ptr != line) {
         static const char backspace[] = {0x08, 0x20, 0x08, 0x00};
-        shell_printf(backspace);
+        if (!shell_machine)
+          shell_printf(backspace);
         ptr--;
       }
       continue;
     }
     // New line (Enter)
     if (c == '\r') {
-      shell_printf(VNA_SHELL_NEWLINE_STR);
+      if (!shell_machine)
+        shell_printf(VNA_SHELL_NEWLINE_STR);
       *ptr = 0;
       return 1;
     }
@@ -2672,17 +3001,31 @@ static int VNAShell_readLine(char *line, int max_size)
       continue;
     // Store
     if (ptr < line + max_size - 1) {
-      streamPut(shell_stream, c); // Echo
+      if (!shell_machine)
+        streamPut(shell_stream, c); // Echo
       *ptr++ = (char)c;
     }
   }
   return 0;
 }
 
+// Run function in sweep thread (sweep breaks on OP_CONSOLE) and sleep till it is done
+static void VNAShell_handover(vna_shellcmd_t function)
+{
+  shell_out_end();
+  chSysLock();
+  shell_function = function;
+  operation_requested|=OP_CONSOLE;
+  chThdResumeI(&sweep_waiting, MSG_OK);
+  chThdSuspendS(&shell_waiting);
+  chSysUnlock();
+  shell_out_begin();
+}
+
 //
-// Parse and run command line
+// Parse and run one command
 //
-static void VNAShell_executeLine(char *line)
+static int VNAShell_executeCommand(char *line)
 {
   // Parse and execute line
   char *lp = line, *ep;
@@ -2699,40 +3042,80 @@ static void VNAShell_executeLine(char *line)
     if ((lp = ep) == NULL) break;
     // Argument limits check
     if (shell_nargs > VNA_SHELL_MAX_ARGUMENTS) {
-      shell_printf("too many arguments, max " define_to_STR(
-          VNA_SHELL_MAX_ARGUMENTS) "" VNA_SHELL_NEWLINE_STR);
-      return;
+      if (!shell_machine)
+        shell_printf("too many arguments, max " define_to_STR(
+            VNA_SHELL_MAX_ARGUMENTS) "" VNA_SHELL_NEWLINE_STR);
+      return SHELL_TOO_MANY_ARGS;
     }
     // Set zero at the end of string and continue check
     *lp++ = 0;
   }
-  if (shell_nargs == 0) return;
+  if (shell_nargs == 0) return SHELL_OK;
   // Execute line
   const VNAShellCommand *scp;
   for (scp = commands; scp->sc_name != NULL; scp++) {
     if (strcmp(scp->sc_name, shell_args[0]) == 0) {
       if (scp->flags & CMD_WAIT_MUTEX) {
-        shell_function = scp->sc_function;
-        operation_requested|=OP_CONSOLE;
-        // Wait execute command in sweep thread
-        do {
-          osalThreadSleepMilliseconds(100);
-        } while (shell_function);
+        VNAShell_handover(scp->sc_function);
       } else {
         operation_requested = false; // otherwise commands  will be aborted
         scp->sc_function(shell_nargs - 1, &shell_args[1]);
-        if (dirty) {
-          operation_requested = true;   // ensure output is updated
+        if (dirty && !settings_staged) {
+          if (dirty & DIRTY_SETUP)
+            operation_requested = true;   // ensure output is updated
           if (MODE_OUTPUT(setting.mode))
             draw_menu();    // update screen if in output mode and dirty
           else
             redraw_request |= REDRAW_CAL_STATUS | REDRAW_AREA | REDRAW_FREQUENCY;
         }
+        chThdResume(&sweep_waiting, MSG_OK);  // Handle redraw now
       }
-      return;
+      if (settings_staged)
+        settings_staged_time = chVTGetSystemTimeX();
+      return SHELL_OK;
+    }
+  }
+  if (!shell_machine)
+    shell_printf("%s?" VNA_SHELL_NEWLINE_STR, shell_args[0]);
+  return SHELL_UNKNOWN;
+}
+
+//
+// Run command line, in machine mode split on ';' (outside quotes) and reply a status code per command
+//
+static void VNAShell_executeLine(char *line)
+{
+  bool batch = false;
+  shell_out_begin();
+  if (!shell_machine) {
+    VNAShell_executeCommand(line);
+    shell_out_end();
+    return;
+  }
+  do {
+    char *lp = line;
+    int quoted = false;
+    while (*lp && (quoted || *lp != ';')) {
+      if (*lp == '"') quoted = !quoted;
+      lp++;
     }
+    char *next = *lp ? lp + 1 : NULL;
+    *lp = 0;
+    if (next && !settings_staged) {   // More than one command, apply all settings at once
+      shell_nargs = 1;
+      VNAShell_handover(cmd_stage);
+      batch = true;
+    }
+    int status = VNAShell_executeCommand(line);
+    if (shell_nargs)                  // No status for an empty line or command
+      shell_printf("%d" VNA_SHELL_NEWLINE_STR, status);
+    line = next;
+  } while (line);
+  if (batch) {
+    shell_nargs = 1;
+    VNAShell_handover(cmd_commit);
   }
-  shell_printf("%s?" VNA_SHELL_NEWLINE_STR, shell_args[0]);
+  shell_out_end();
 }
 
 #ifdef VNA_SHELL_THREAD
@@ -2743,7 +3126,8 @@ THD_FUNCTION(myshellThread, p)
   chRegSetThreadName("shell");
   shell_printf(VNA_SHELL_NEWLINE_STR"tinySA Shell"VNA_SHELL_NEWLINE_STR);
   while (true) {
-    shell_printf(VNA_SHELL_PROMPT_STR);
+    if (!shell_machine)
+      shell_printf(VNA_SHELL_PROMPT_STR);
     if (VNAShell_readLine(shell_line, VNA_SHELL_MAX_LENGTH))
       VNAShell_executeLine(shell_line);
     else // Putting a delay in order to avoid an endless loop trying to read an unavailable stream.
@@ -2994,12 +3378,17 @@ int main(void)
 #else
       shell_printf(VNA_SHELL_NEWLINE_STR"tinySA Shell"VNA_SHELL_NEWLINE_STR);
       do {
-        shell_printf(VNA_SHELL_PROMPT_STR);
+        if (!shell_machine)
+          shell_printf(VNA_SHELL_PROMPT_STR);
         if (VNAShell_readLine(shell_line, VNA_SHELL_MAX_LENGTH))
           VNAShell_executeLine(shell_line);
         else
           chThdSleepMilliseconds(200);
       } while (SDU1.config->usbp->state == USB_ACTIVE);
+      if (settings_staged) {                      // Host left without commit
+        shell_nargs = 1;
+        VNAShell_handover(cmd_commit);
+      }
 #endif
     }
     chThdSleepMilliseconds(1000);
@@ -3017,7 +3406,11 @@ void HardFault_Handler(void)
 {
   uint32_t *sp;
   //__asm volatile ("mrs %0, msp \n\t": "=r" (sp) );
+#ifdef __ARM_ARCH
   __asm volatile("mrs %0, psp \n\t" : "=r"(sp));
+#else
+  sp = NULL;          // Host simulation, no exception frame
+#endif
   hard_fault_handler_c(sp);
 }
 
@@ -38,6 +38,8 @@
 #endif
 #define __PE4302__
 //#define __SIMULATION__
+//#define __SI4432_SPI__        // Use SPI2 peripheral for SI4432/PE4302 bus instead of bit banging
+//#define __SI4432_BUS_MOCK__   // Replace SI4432/PE4302 bus with RAM register model, for use without radio board
 //#define __PIPELINE__
 #define __SCROLL__
 #define __ICONS__
@@ -53,6 +55,15 @@
 #define __SINGLE_LETTER__
 #define __NICE_BIG_FONT__
 #define __QUASI_PEAK__
+#define __BENCH__               // Add bench command for per stage sweep timing
+//#define __SWEEP_STREAM__      // Add stream command, sends every completed sweep as a framed binary block (1.5kB RAM)
+//#define __ADAPTIVE_SETTLE__   // Add adaptive scan speed, RSSI settle wait ends when readings converge (290B RAM)
+#define __REFINE_SWEEP__        // Add refine command, coarse wide RBW sweep with narrow RBW re-measure around peaks
+//#define __SWEEP_HISTORY__     // Add history command, last sweeps quantized in RAM can be replayed on the waterfall and dumped (2kB RAM)
+#define __HEADLESS__            // Add headless and stat commands, sweep without any screen rendering for remote acquisition
+//#define __SCAN_JOBS__         // Add job command, queued scans run between sweeps, results fetched later by id (needs __SWEEP_STREAM__)
+//#define __TRACE_SPANS__       // Draw rectangular traces as per column y spans built once per sweep, not lines per cell (1.7kB RAM)
+//#define __WATERFALL_RATE_CAP__ // Drop waterfall lines of sweeps ending within 40ms of the last line, fast zero span sweeps lose rows
 //#define __REMOTE_DESKTOP__
 
 #ifdef TINYSA3
@@ -175,6 +186,7 @@ void send_buffer(uint8_t * buf, int s);
 #endif
 void set_marker_frequency(int m, freq_t f);
 void toggle_sweep(void);
+void wakeup_sweep_threadI(void);
 void toggle_mute(void);
 void load_default_properties(void);
 
@@ -209,6 +221,17 @@ enum {
 
 extern uint8_t sweep_mode;
 extern bool completed;
+
+// dirty bits, what must be set up again before the next sweep. dirty = true does a full setup
+#define DIRTY_ALL         0x01
+#define DIRTY_LO          0x02      // Frequencies, IF, spur removal: sweep plan and RBW
+#define DIRTY_RBW         0x04      // RBW and step delay
+#define DIRTY_ATTENUATION 0x08      // Attenuator
+#define DIRTY_CORRECTION  0x10      // Level correction and offset
+#define DIRTY_AVERAGE     0x20      // Only restart averaging, hold and decay
+#define DIRTY_DISPLAY     0x40      // Only redraw, keeps averaged data and does not break sweep
+#define DIRTY_SETUP       (~DIRTY_DISPLAY)
+extern uint16_t dirty;
 extern const char *info_about[];
 
 // ------------------------------- sa_core.c ----------------------------------
@@ -236,6 +259,7 @@ int search_is_greater(void);
 void set_auto_attenuation(void);
 void set_auto_reflevel(int);
 int is_paused(void);
+int is_staged(void);
 void set_actual_power(float);
 void SetGenerate(int);
 void set_RBW(uint32_t rbw_x10);
@@ -265,6 +289,33 @@ void  set_subtract_storage(void);
 void  toggle_normalize(void);
 void toggle_waterfall(void);
 void disable_waterfall(void);
+#ifdef __SWEEP_HISTORY__
+#define SWEEP_HISTORY_SIZE  2048    // 13 sweeps of 290 points in 4 bit (156 bytes per row), 6 in 8 bit, more with less points
+typedef struct {
+  uint32_t timestamp;               // System ticks at end of sweep
+  int16_t  ref_x32;                 // Level of the highest value in dBm * 32
+  uint16_t step_x32;                // Level per value step in dB * 32
+} sweep_history_row_t;              // Followed by the points, 4 bit packed low nibble first or 8 bit
+
+typedef struct {
+  freq_t   start;
+  freq_t   stop;
+  uint16_t points;
+  uint16_t row_size;                // Bytes per row including sweep_history_row_t, multiple of 4
+  uint8_t  bits;                    // 4 or 8 bit per point
+  uint8_t  capacity;
+  uint8_t  rows;                    // Valid rows
+  uint8_t  head;                    // Next row to write
+} sweep_history_t;
+
+extern sweep_history_t sweep_history;
+extern uint8_t sweep_history_buf[SWEEP_HISTORY_SIZE];
+void sweep_history_clear(int bits);
+void sweep_history_push(void);
+sweep_history_row_t *sweep_history_row(int n);  // n = 0 is newest
+int sweep_history_value(int n, int i);
+void sweep_history_replay(int gray);
+#endif
 void set_mode(int);
 int GetMode(void);
 void set_reflevel(float);
@@ -285,6 +336,7 @@ void set_noise(int);
 void toggle_tracking_output(void);
 extern int32_t frequencyExtra;
 void set_10mhz(freq_t);
+void set_headless(int);
 void set_modulation(int);
 void set_modulation_frequency(int);
 int search_maximum(int m, int center, int span);
@@ -542,12 +594,18 @@ typedef struct config {
   int8_t    cor_wfm;
   int8_t    cor_nfm;
   float sweep_voltage;
-  uint32_t    dummy;
+  uint8_t  headless;             // In the former dummy word so saved configs keep their layout
+  uint8_t  dummy[3];
 //  uint8_t _reserved[22];
   freq_t checksum;
 } config_t;
 
 extern config_t config;
+#ifdef __HEADLESS__
+#define HEADLESS()  (config.headless)
+#else
+#define HEADLESS()  false
+#endif
 //#define settingLevelOffset config.level_offset
 float get_level_offset(void);
 
@@ -611,6 +669,9 @@ void request_to_draw_cells_behind_numeric_input(void);
 void redraw_marker(int marker);
 void markmap_all_markers(void);
 void plot_into_index(measurement_t measured);
+#ifdef __HEADLESS__
+void plot_into_actual_index(measurement_t measured);
+#endif
 void force_set_markmap(void);
 void draw_frequencies(void);
 void draw_all(bool flush);
@@ -650,8 +711,13 @@ extern volatile uint8_t redraw_request;
 #define RGBHEX(hex) ( (((hex)&0x001c00)<<3) | (((hex)&0x0000f8)<<5) | (((hex)&0xf80000)>>16) | (((hex)&0x00e000)>>13) )
 #define HEXRGB(hex) ( (((hex)>>3)&0x001c00) | (((hex)>>5)&0x0000f8) | (((hex)<<16)&0xf80000) | (((hex)<<13)&0x00e000) )
 
+// Cell render buffers: with 2 (and __USE_DISPLAY_DMA__) the next cell is rendered while DMA sends the
+// previous one, this roughly halves full screen redraw time but needs one more cell of RAM (2kB)
+#ifndef DISPLAY_CELL_BUFFER_COUNT
+#define DISPLAY_CELL_BUFFER_COUNT   1
+#endif
 // Define size of screen buffer in pixels (one pixel 16bit size)
-#define SPI_BUFFER_SIZE             (CELLWIDTH*CELLHEIGHT)
+#define SPI_BUFFER_SIZE             (CELLWIDTH*CELLHEIGHT*DISPLAY_CELL_BUFFER_COUNT)
 
 #define LCD_WIDTH                   320
 #define LCD_HEIGHT                  240
@@ -736,6 +802,9 @@ extern uint16_t spi_buffer[SPI_BUFFER_SIZE];
 void ili9341_init(void);
 void ili9341_test(int mode);
 void ili9341_bulk(int x, int y, int w, int h);
+uint16_t *ili9341_get_cell_buffer(void);
+void ili9341_bulk_continue(int x, int y, int w, int h, uint16_t *buffer);
+void ili9341_bulk_finish(void);
 void ili9341_fill(int x, int y, int w, int h);
 
 void ili9341_set_foreground(uint16_t fg_idx);
@@ -847,7 +916,7 @@ void reset_settings(int m);
 #define S_STATE(X) ((X)&1)
 enum { S_OFF=0, S_ON=1, S_AUTO_OFF=2, S_AUTO_ON=3 };
 
-enum { SD_NORMAL, SD_PRECISE, SD_FAST, SD_MANUAL };
+enum { SD_NORMAL, SD_PRECISE, SD_FAST, SD_MANUAL, SD_ADAPTIVE };
 
 #ifdef __FAST_SWEEP__
 #define MINIMUM_SWEEP_TIME  1800U    // Minimum sweep time on zero span in uS
@@ -1089,6 +1158,17 @@ int plot_printf(char *str, int, const char *fmt, ...);
 #define RESTART_PROFILE   time = chVTGetSystemTimeX();
 #define STOP_PROFILE    {char string_buf[12];plot_printf(string_buf, sizeof string_buf, "%06d", chVTGetSystemTimeX() - time);ili9341_drawstring(string_buf, 0, FREQUENCIES_YPOS);}
 #define DELTA_TIME (time = chVTGetSystemTimeX() - time)
+
+#ifdef __BENCH__
+// Sweep stage timing, SysTick runs free at CPU clock only while the bench command is active
+enum { BENCH_LO, BENCH_SETTLE, BENCH_RSSI, BENCH_TRACE, BENCH_POST, BENCH_PLOT, BENCH_MAX };
+extern uint32_t bench_ticks[BENCH_MAX];
+#define BENCH_BEGIN(t)        uint32_t t = SysTick->VAL
+#define BENCH_END(t, stage)   bench_ticks[stage] += (t - SysTick->VAL) & SysTick_LOAD_RELOAD_Msk
+#else
+#define BENCH_BEGIN(t)
+#define BENCH_END(t, stage)
+#endif
 // Macros for convert define value to string
 #define STR1(x)  #x
 #define define_to_STR(x)  STR1(x)
@@ -1104,7 +1184,18 @@ typedef int16_t  pureRSSI_t;
 #define DEVICE_TO_PURE_RSSI(rssi) ((rssi)<<4)
 #define PURE_TO_DEVICE_RSSI(rssi) ((rssi)>>4)
 #define float_TO_PURE_RSSI(rssi)  ((rssi)*32)
-#define PURE_TO_float(rssi)       ((rssi)/32.0)
+#define PURE_TO_float(rssi)       ((rssi)*(1.0f/32))     // Single precision, a double divide is very slow without FPU
+
+// Averaging state of the actual trace, 1/128dB (2 more fraction bits than pureRSSI_t) so slow
+// averages settle within 1/16dB of the float result, int16 still covers -256dB..+256dB
+typedef int16_t  avgRSSI_t;
+#define AVG_FRACTION_BITS         2
+#define PURE_TO_AVG_RSSI(rssi)    ((rssi)*(1<<AVG_FRACTION_BITS))
+#define AVG_TO_PURE_RSSI(avg)     (((avg) + (1<<(AVG_FRACTION_BITS-1))) >> AVG_FRACTION_BITS)
+#define AVG_TO_float(avg)         ((avg)*(1.0f/(32<<AVG_FRACTION_BITS)))
+// One step of the running average over 2^shift sweeps, rounded
+#define AVG_RSSI_STEP(avg, rssi, shift) \
+  (((int32_t)(avg) * ((1<<(shift)) - 1) + PURE_TO_AVG_RSSI((int32_t)(rssi)) + (1<<((shift)-1))) >> (shift))
 
 extern uint16_t actual_rbw_x10;
 
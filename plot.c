@@ -49,7 +49,7 @@ static freq_t grid_span;
 int16_t area_width  = AREA_WIDTH_NORMAL;
 int16_t area_height; // initialized in main()  = AREA_HEIGHT_NORMAL;
 
-// Cell render use spi buffer
+// Cell render use spi buffer, switched between DISPLAY_CELL_BUFFER_COUNT cells by draw_cell
 typedef uint16_t pixel_t;
 pixel_t *cell_buffer = (pixel_t *)spi_buffer;
 // Cell size
@@ -57,7 +57,7 @@ pixel_t *cell_buffer = (pixel_t *)spi_buffer;
 //#define CELLWIDTH  (64) // moved to nanovna.h
 //#define CELLHEIGHT (32)
 // Check buffer size
-#if CELLWIDTH*CELLHEIGHT > SPI_BUFFER_SIZE
+#if CELLWIDTH*CELLHEIGHT*DISPLAY_CELL_BUFFER_COUNT > SPI_BUFFER_SIZE
 #error "Too small spi_buffer size SPI_BUFFER_SIZE < CELLWIDTH*CELLHEIGH"
 #endif
 
@@ -119,6 +119,8 @@ float2int(float v)
   return 0;
 }
 
+static void update_grid_cache(void);
+
 void update_grid(void)
 {
   freq_t gdigit = 1000000000;
@@ -130,6 +132,8 @@ void update_grid(void)
     fspan = setting.actual_sweep_time_us; // Time in uS
     fstart = 0;
   }
+  if (fspan < 1000)                       // Not set up yet at power on, do not divide by zero
+    fspan = 1000;
   if (config.gridlines < 3)
     config.gridlines = 6;
 
@@ -150,6 +154,7 @@ void update_grid(void)
   grid_offset = (WIDTH) * ((fstart % grid) / 100) / (fspan / 100);
   grid_width = (WIDTH) * (grid / 100) / (fspan / 1000);
 
+  update_grid_cache();
   force_set_markmap();
   if (get_waterfall()){
     ili9341_set_background(LCD_BG_COLOR);
@@ -479,6 +484,45 @@ rectangular_grid_y(int y)
   return 0;
 }
 
+// Rectangular grid cache, one bit per screen pixel, cell m uses word m of the x masks and cell n word n of the y mask
+#if CELLWIDTH != 32 || CELLHEIGHT != 32
+#error "Grid cache expects 32x32 cells, one mask word per cell"
+#endif
+#define GRID_MASK_X  ((LCD_WIDTH + 31) / 32)
+#define GRID_MASK_Y  ((LCD_HEIGHT + 31) / 32)
+static uint32_t grid_x_mask[GRID_MASK_X];     // Vertical grid lines
+static uint32_t grid_area_mask[GRID_MASK_X];  // Columns crossed by horizontal grid lines
+static uint32_t grid_y_mask[GRID_MASK_Y];     // Horizontal grid lines
+#ifdef __HAM_BAND__
+static uint32_t ham_x_mask[GRID_MASK_X];      // Columns inside a ham band
+#endif
+
+static void
+update_grid_cache(void)
+{
+  int i;
+  memset(grid_x_mask, 0, sizeof grid_x_mask);
+  memset(grid_area_mask, 0, sizeof grid_area_mask);
+  memset(grid_y_mask, 0, sizeof grid_y_mask);
+#ifdef __HAM_BAND__
+  memset(ham_x_mask, 0, sizeof ham_x_mask);
+#endif
+  for (i = 0; i < LCD_WIDTH; i++) {
+    uint32_t bit = 1U << (i & 31);
+    if (rectangular_grid_x(i))
+      grid_x_mask[i >> 5] |= bit;
+    if (i >= CELLOFFSETX && i <= WIDTH + CELLOFFSETX)
+      grid_area_mask[i >> 5] |= bit;
+#ifdef __HAM_BAND__
+    if (i <= WIDTH && ham_band(i))                 // Chart area only, frequencies[] has no entry beyond
+      ham_x_mask[i >> 5] |= bit;
+#endif
+  }
+  for (i = 0; i < LCD_HEIGHT; i++)
+    if (rectangular_grid_y(i))
+      grid_y_mask[i >> 5] |= 1U << (i & 31);
+}
+
 #if 0
 int
 set_strut_grid(int x)
@@ -693,7 +737,7 @@ gamma2reactance(const float v[2])
 #endif
 
 static index_t
-trace_into_index(int t, int i, float array[POINTS_COUNT])
+trace_into_index(int t, int i, float *array)
 {
   int y, x;
   float coeff = array[i];
@@ -1141,6 +1185,68 @@ cell_drawline(int x0, int y0, int x1, int y1, int c)
   }
 }
 
+#ifdef __TRACE_SPANS__
+// Vertical extent of a rectangular trace in every screen column, x is monotonic
+// in the point index so each column of the polyline is one span ymin..ymax
+typedef struct {
+  uint8_t ymin;
+  uint8_t ymax;
+} trace_span_t;
+static trace_span_t trace_span[TRACES_MAX][WIDTH+1];
+
+// Walk the trace with the same Bresenham steps as cell_drawline, so the spans
+// hold exactly the line pixels, and every point when there are more points than columns
+static void
+trace_span_build(int t)
+{
+  trace_span_t *span = trace_span[t];
+  index_t *index = trace_index[t];
+  int i;
+  for (i = 0; i <= WIDTH; i++) {
+    span[i].ymin = 0xFF;
+    span[i].ymax = 0;
+  }
+  for (i = 0; i < sweep_points - 1; i++) {
+    int x0 = CELL_X(index[i]),   y0 = CELL_Y(index[i]);
+    int x1 = CELL_X(index[i+1]), y1 = CELL_Y(index[i+1]);
+    if (x1 < x0) { SWAP(x0, x1); SWAP(y0, y1); }
+    int dx = x1 - x0;
+    int dy = y1 - y0, sy = 1; if (dy < 0) { dy = -dy; sy = -1; }
+    int err = (dx > dy ? dx : -dy) / 2;
+    while (1) {
+      if (x0 >= 0 && x0 <= WIDTH) {
+        if (y0 < span[x0].ymin) span[x0].ymin = y0;
+        if (y0 > span[x0].ymax) span[x0].ymax = y0;
+      }
+      if (x0 == x1 && y0 == y1)
+        break;
+      int e2 = err;
+      if (e2 > -dx) { err -= dy; x0++;  }
+      if (e2 <  dy) { err += dx; y0+=sy;}
+    }
+  }
+}
+
+// Fill the trace spans of the cell columns
+static void
+cell_draw_spans(int t, int x0, int y0, int w, int h, int c)
+{
+  trace_span_t *span = &trace_span[t][x0];
+  int x, y;
+  if (x0 + w > WIDTH + 1)
+    w = WIDTH + 1 - x0;
+  for (x = 0; x < w; x++) {
+    int y1 = span[x].ymin - y0;
+    int y2 = span[x].ymax - y0;
+    if (y1 < 0) y1 = 0;
+    if (y2 >= h) y2 = h - 1;
+    for (y = y1; y <= y2; y++)
+      cell_buffer[y * CELLWIDTH + x] |= c;
+  }
+}
+#endif
+
+#ifndef __TRACE_SPANS__
 // Give a little speedup then draw rectangular plot (50 systick on all calls, all render req 700 systick)
 // Write more difficult algoritm for seach indexes not give speedup
 static int
@@ -1182,6 +1288,7 @@ search_index_range_x(int x1, int x2, index_t index[POINTS_COUNT], int *i0, int *
 
   return TRUE;
 }
+#endif
 #if 0       // Not used as refpos is always at top of screen
 #define REFERENCE_WIDTH    6
 #define REFERENCE_HEIGHT   5
@@ -1508,6 +1615,10 @@ plot_into_index(measurement_t measured)
     index_t *index = trace_index[t];
     for (i = 0; i < sweep_points; i++)
       index[i] = trace_into_index(t, i, measured[ch]);
+#ifdef __TRACE_SPANS__
+    if (!((1 << trace[t].type) & ((1 << TRC_SMITH) | (1 << TRC_POLAR))))
+      trace_span_build(t);
+#endif
   }
 //  STOP_PROFILE
 #if 0
@@ -1520,6 +1631,20 @@ plot_into_index(measurement_t measured)
   markmap_all_markers();
 }
 
+#ifdef __HEADLESS__
+// Headless sweeps skip plot_into_index, marker tracking still needs the actual trace index
+void
+plot_into_actual_index(measurement_t measured)
+{
+  int i;
+  if (!trace[TRACE_ACTUAL].enabled)
+    return;
+  index_t *index = trace_index[TRACE_ACTUAL];
+  for (i = 0; i < sweep_points; i++)
+    index[i] = trace_into_index(TRACE_ACTUAL, i, measured[trace[TRACE_ACTUAL].channel]);
+}
+#endif
+
 static void
 draw_cell(int m, int n)
 {
@@ -1538,33 +1663,10 @@ draw_cell(int m, int n)
     h = area_height - y0;
   if (w <= 0 || h <= 0)
     return;
+  cell_buffer = ili9341_get_cell_buffer();
 //  PULSE;
 
-  // Clear buffer ("0 : height" lines)
-#if 0
-  // use memset 350 system ticks for all screen calls
-  // as understand it use 8 bit set, slow down on 32 bit systems
-  memset(spi_buffer, LCD_BG_COLOR, (h*CELLWIDTH)*sizeof(uint16_t));
-#else
-  // use direct set  35 system ticks for all screen calls
-#if CELLWIDTH%8 != 0
-#error "CELLWIDTH % 8 should be == 0 for speed, or need rewrite cell cleanup"
-#endif
-  // Set LCD_BG_COLOR for 8 pixels in one cycle
-  int count = h*CELLWIDTH / 8;
-  uint32_t *p = (uint32_t *)cell_buffer;
-  uint32_t clr = GET_PALTETTE_COLOR(LCD_BG_COLOR) | (GET_PALTETTE_COLOR(LCD_BG_COLOR) << 16);
-  while (count--) {
-    p[0] = clr;
-    p[1] = clr;
-    p[2] = clr;
-    p[3] = clr;
-    p += 4;
-  }
-#endif
-
 // Draw grid
-#if 1
   c = GET_PALTETTE_COLOR(LCD_GRID_COLOR);
   // Generate grid type list
   uint32_t trace_type = 0;
@@ -1573,24 +1675,39 @@ draw_cell(int m, int n)
       trace_type |= (1 << trace[t].type);
     }
   }
-  // Draw rectangular plot (40 system ticks for all screen calls)
+  // Build one background line from the grid cache, then fill the cell with
+  // 32 bit copies of it, only horizontal grid lines need per pixel writes
+#if CELLWIDTH%8 != 0
+#error "CELLWIDTH % 8 should be == 0 for speed, or need rewrite cell cleanup"
+#endif
+  uint32_t vline = 0, hline = 0, yline = 0, ham = 0;
   if (trace_type & RECTANGULAR_GRID_MASK) {
-    for (x = 0; x < w; x++) {
+    vline = grid_x_mask[m];
+    hline = grid_area_mask[m];
+    yline = grid_y_mask[n];
 #ifdef __HAM_BAND__
-      if (ham_band(x+x0)) {
-        for (y = 0; y < h; y++) cell_buffer[y * CELLWIDTH + x] = GET_PALTETTE_COLOR(LCD_HAM_COLOR);
-      }
+    ham   = ham_x_mask[m];
 #endif
-      if (rectangular_grid_x(x + x0)) {
-        for (y = 0; y < h; y++) cell_buffer[y * CELLWIDTH + x] = c;
-      }
+  }
+  uint32_t line[CELLWIDTH/2];
+  pixel_t *lp = (pixel_t *)line;
+  for (x = 0; x < CELLWIDTH; x++) {
+    uint32_t bit = 1U << x;
+    lp[x] = (vline & bit) ? c : (ham & bit) ? GET_PALTETTE_COLOR(LCD_HAM_COLOR) : GET_PALTETTE_COLOR(LCD_BG_COLOR);
+  }
+  uint32_t *p = (uint32_t *)cell_buffer;
+  for (y = 0; y < h; y++, p += CELLWIDTH/2) {
+    for (x = 0; x < CELLWIDTH/2; x += 4) {
+      p[x+0] = line[x+0];
+      p[x+1] = line[x+1];
+      p[x+2] = line[x+2];
+      p[x+3] = line[x+3];
     }
-    for (y = 0; y < h; y++) {
-      if (rectangular_grid_y(y + y0)) {
-        for (x = 0; x < w; x++)
-          if (x + x0 >= CELLOFFSETX && x + x0 <= WIDTH + CELLOFFSETX)
-            cell_buffer[y * CELLWIDTH + x] = c;
-      }
+    if (yline & (1U << y)) {
+      pixel_t *row = (pixel_t *)p;
+      for (x = 0; x < w; x++)
+        if (hline & (1U << x))
+          row[x] = c;
     }
   }
 #ifdef __VNA__
@@ -1617,7 +1734,6 @@ draw_cell(int m, int n)
 #endif
 #endif
 //  PULSE;
-#endif
 // Draw trigger line
   if (setting.trigger != T_AUTO) {
     int tp = get_trigger_level() - y0;
@@ -1646,9 +1762,16 @@ draw_cell(int m, int n)
     uint32_t trace_type = (1 << trace[t].type);
     if (trace_type & ((1 << TRC_SMITH) | (1 << TRC_POLAR)))
       i1 = sweep_points - 1;
+#ifdef __TRACE_SPANS__
+    else {  // rectangular plot from the per sweep column spans
+      cell_draw_spans(t, x0, y0, w, h, c);
+      continue;
+    }
+#else
     else  // draw rectangular plot (search index range in cell, save 50-70
           // system ticks for all screen calls)
       search_index_range_x(x0, x0 + w, trace_index[t], &i0, &i1);
+#endif
     index_t *index = trace_index[t];
     for (i = i0; i < i1; i++) {
       int x1 = CELL_X(index[i]) - x0;
@@ -1726,8 +1849,8 @@ draw_cell(int m, int n)
         *dst++ = *src++;
   }
 #endif
-  // Draw cell (500 system ticks for all screen calls)
-  ili9341_bulk(OFFSETX + x0, OFFSETY + y0, w, h);
+  // Draw cell (500 system ticks for all screen calls), DMA runs while the next cell is rendered
+  ili9341_bulk_continue(OFFSETX + x0, OFFSETY + y0, w, h, cell_buffer);
 }
 
 extern float peakLevel;
@@ -1750,6 +1873,7 @@ draw_all_cells(bool flush_markmap)
 //      else
 //        ili9341_fill(m*CELLWIDTH+10, n*CELLHEIGHT, 2, 2, RGB565(0,255,0));
     }
+  ili9341_bulk_finish();
 //  STOP_PROFILE
   if (flush_markmap) {
     // keep current map for update
@@ -2384,6 +2508,11 @@ redraw_frame(void)
 {
   ili9341_set_background(LCD_BG_COLOR);
   ili9341_clear_screen();
+  if (HEADLESS()) {                         // Only a note, nothing else is drawn till headless off
+    ili9341_set_foreground(LCD_FG_COLOR);
+    ili9341_drawstring("HEADLESS: screen updates off", OFFSETX + 4, LCD_HEIGHT/2);
+    return;
+  }
   draw_frequencies();
   draw_cal_status();
 }
@@ -2414,15 +2543,54 @@ int display_test(void)
 #include "waterfall.c"
 #endif
 
+// Gradient palette for y in range 0 (bottom level) .. SMALL_WATERFALL (reference level)
+static uint16_t waterfall_color(uint16_t y)
+{
+  // Calculate gradient palette for range 0 .. 192
+  // idx     r   g   b
+  //   0 - 127   0   0
+  //  32 - 255 127   0
+  //  64 - 255 255 127
+  //  96 - 255 255 255
+  // 128 - 127 255 255
+  // 160 -   0 127 255
+  // 192 -   0   0 127
+  // 224 -   0   0   0
+  if (y <  32) return RGB565( 127+((y-  0)*4),   0+((y-  0)*4),               0);
+  if (y <  64) return RGB565(             255, 127+((y- 32)*4),   0+((y- 32)*4));
+  if (y <  96) return RGB565(             255,             255, 127+((y- 64)*4));
+  if (y < 128) return RGB565( 252-((y- 96)*4),             255,             255);
+  if (y < 160) return RGB565( 124-((y-128)*4), 252-((y-128)*4),             255);
+  return              RGB565(               0, 124-((y-160)*4), 252-((y-160)*4));
+}
+
+// In landscape the ILI9341 hardware scroll (VSCRDEF/VSCRSADD) moves columns over the full screen height,
+// so the waterfall is scrolled by copying LCD memory.
+#ifdef __WATERFALL_RATE_CAP__
+// A sweep ending within the interval of the last drawn line is dropped from the waterfall, rows are then
+// wall clock time and no longer one per sweep.
+#define WATERFALL_INTERVAL  TIME_MS2I(40)     // Maximum 25 lines per second
+#endif
+
 static void update_waterfall(void){
   int i;
   int w_width = area_width < WIDTH ? area_width : WIDTH;
   // Waterfall only in 290 or 145 points
 //  if (!(sweep_points == 290 || sweep_points == 145))
 //    return;
-  for (i = CHART_BOTTOM-1; i >=graph_bottom+1; i--) {		// Scroll down
-    ili9341_read_memory(OFFSETX, i  , w_width, 1, w_width*1, spi_buffer);
-           ili9341_bulk(OFFSETX, i+1, w_width, 1);
+#ifdef __WATERFALL_RATE_CAP__
+  static systime_t last_line;
+  systime_t now = chVTGetSystemTimeX();
+  if (now - last_line < WATERFALL_INTERVAL)
+    return;
+  last_line = now;
+#endif
+  // Scroll down, as many lines per transfer as spi_buffer holds (read is 3 bytes per pixel)
+  int rows = (sizeof(spi_buffer) - 1) / (3 * w_width);
+  for (i = CHART_BOTTOM-1; i >=graph_bottom+1; i -= rows) {
+    int n = i - graph_bottom < rows ? i - graph_bottom : rows;
+    ili9341_read_memory(OFFSETX, i-n+1, w_width, n, w_width*n, spi_buffer);
+           ili9341_bulk(OFFSETX, i-n+2, w_width, n);
   }
   index_t *index = trace_index[TRACE_ACTUAL];
   int j = 0;
@@ -2450,24 +2618,8 @@ static void update_waterfall(void){
     color = RGB565(r, g, b);
 #else
     uint16_t y = SMALL_WATERFALL - CELL_Y(index[i])* (graph_bottom == BIG_WATERFALL ? 2 : 1); // should be always in range 0 - graph_bottom *2 depends on height of scroll
-    // Calculate gradient palette for range 0 .. 192
-    // idx     r   g   b
-    //   0 - 127   0   0
-    //  32 - 255 127   0
-    //  64 - 255 255 127
-    //  96 - 255 255 255
-    // 128 - 127 255 255
-    // 160 -   0 127 255
-    // 192 -   0   0 127
-    // 224 -   0   0   0
 //    y = (uint8_t)i;  // for test
-         if (y <  32) color = RGB565( 127+((y-  0)*4),   0+((y-  0)*4),               0);
-    else if (y <  64) color = RGB565(             255, 127+((y- 32)*4),   0+((y- 32)*4));
-    else if (y <  96) color = RGB565(             255,             255, 127+((y- 64)*4));
-    else if (y < 128) color = RGB565( 252-((y- 96)*4),             255,             255);
-    else if (y < 160) color = RGB565( 124-((y-128)*4), 252-((y-128)*4),             255);
-    else              color = RGB565(               0, 124-((y-160)*4), 252-((y-160)*4));
-
+    color = waterfall_color(y);
 #endif
     while (j * sweep_points  < (i+1) * WIDTH) {   // Scale waterfall to WIDTH points
       spi_buffer[j++] = color;
@@ -2500,6 +2652,7 @@ toggle_waterfall(void)
     waterfall = W_OFF;
   }
   _grid_y = graph_bottom / NGRIDY;
+  update_grid_cache();
   ili9341_set_background(LCD_BG_COLOR);
   ili9341_fill(OFFSETX, graph_bottom, LCD_WIDTH - OFFSETX, CHART_BOTTOM - graph_bottom);
   request_to_redraw_grid();
@@ -2511,11 +2664,128 @@ disable_waterfall(void)
   graph_bottom = NO_WATERFALL;
   waterfall = W_OFF;
   _grid_y = graph_bottom / NGRIDY;
+  update_grid_cache();
   ili9341_set_background(LCD_BG_COLOR);
   ili9341_fill(OFFSETX, graph_bottom, LCD_WIDTH - OFFSETX, CHART_BOTTOM - graph_bottom);
   request_to_redraw_grid();
 }
 
+#ifdef __SWEEP_HISTORY__
+#ifndef __SCROLL__
+#error "__SWEEP_HISTORY__ needs __SCROLL__ for the waterfall"
+#endif
+// Ring of the last sweeps, each point quantized to 4 or 8 bit between the reference level (max value)
+// and the bottom of the screen (0). Every row keeps its own reference and step, so it can be drawn again
+// after a reference level or scale change. The ring restarts when start, stop or points change.
+#define HISTORY_LINEAR_RANGE  100                     // dB below reference level in linear units
+
+sweep_history_t sweep_history = { .bits = 4 };
+uint8_t sweep_history_buf[SWEEP_HISTORY_SIZE];
+
+void sweep_history_clear(int bits)
+{
+  sweep_history.bits = bits;
+  sweep_history.points = 0;                           // Set up again on next push
+  sweep_history.rows = 0;
+}
+
+sweep_history_row_t *sweep_history_row(int n)
+{
+  int r = sweep_history.head - 1 - n;
+  if (r < 0)
+    r += sweep_history.capacity;
+  return (sweep_history_row_t *)&sweep_history_buf[r * sweep_history.row_size];
+}
+
+int sweep_history_value(int n, int i)
+{
+  uint8_t *data = (uint8_t *)(sweep_history_row(n) + 1);
+  if (sweep_history.bits == 8)
+    return data[i];
+  return (data[i>>1] >> ((i & 1) * 4)) & 0x0F;
+}
+
+// Level of the screen top and the level range of the screen in 1/32 dB
+static void history_screen_range(int32_t *top, int32_t *range)
+{
+  *top = float_TO_PURE_RSSI(to_dBm(setting.reflevel));
+  *range = float_TO_PURE_RSSI(UNIT_IS_LINEAR(setting.unit) ? HISTORY_LINEAR_RANGE : NGRIDY * setting.scale);
+}
+
+void sweep_history_push(void)
+{
+  freq_t start = get_sweep_frequency(ST_START);
+  freq_t stop = get_sweep_frequency(ST_STOP);
+  if (sweep_history.points != sweep_points || sweep_history.start != start || sweep_history.stop != stop) {
+    sweep_history.start = start;
+    sweep_history.stop = stop;
+    sweep_history.points = sweep_points;
+    sweep_history.row_size = (sizeof(sweep_history_row_t) + (sweep_points * sweep_history.bits + 7) / 8 + 3) & ~3;
+    int capacity = SWEEP_HISTORY_SIZE / sweep_history.row_size;
+    sweep_history.capacity = capacity > 255 ? 255 : capacity;
+    sweep_history.rows = 0;
+    sweep_history.head = 0;
+  }
+  sweep_history_row_t *row = (sweep_history_row_t *)&sweep_history_buf[sweep_history.head * sweep_history.row_size];
+  uint8_t *data = (uint8_t *)(row + 1);
+  int q_max = (1 << sweep_history.bits) - 1;
+  int32_t top, range;
+  history_screen_range(&top, &range);
+  int32_t step = range / q_max;
+  if (step < 1)
+    step = 1;
+  int32_t bottom = top - step * q_max;
+  row->timestamp = chVTGetSystemTimeX();
+  row->ref_x32 = top;
+  row->step_x32 = step;
+  for (int i = 0; i < sweep_points; i++) {
+    int32_t q = ((int32_t)float_TO_PURE_RSSI(actual_t[i]) - bottom + step/2) / step;
+    if (q < 0) q = 0;
+    if (q > q_max) q = q_max;
+    if (sweep_history.bits == 8)
+      data[i] = q;
+    else if (i & 1)
+      data[i>>1] |= q << 4;
+    else
+      data[i>>1] = q;
+  }
+  if (++sweep_history.head >= sweep_history.capacity)
+    sweep_history.head = 0;
+  if (sweep_history.rows < sweep_history.capacity)
+    sweep_history.rows++;
+}
+
+// Draw the waterfall from history, newest on top, with current reference level and scale
+void sweep_history_replay(int gray)
+{
+  if (!waterfall || sweep_history.points == 0)
+    return;
+  int w_width = area_width < WIDTH ? area_width : WIDTH;
+  int q_max = (1 << sweep_history.bits) - 1;
+  int32_t top, range;
+  history_screen_range(&top, &range);
+  int n = 0;
+  for (int line = graph_bottom+1; line <= CHART_BOTTOM; line++, n++) {
+    if (n >= sweep_history.rows) {
+      ili9341_set_background(LCD_BG_COLOR);
+      ili9341_fill(OFFSETX, line, w_width, CHART_BOTTOM + 1 - line);
+      break;
+    }
+    sweep_history_row_t *row = sweep_history_row(n);
+    int j = 0;
+    for (int i = 0; i < sweep_history.points; i++) {
+      int32_t level = row->ref_x32 - (q_max - sweep_history_value(n, i)) * row->step_x32;
+      int32_t y = (level - (top - range)) * SMALL_WATERFALL / range;
+      if (y < 0) y = 0;
+      if (y > SMALL_WATERFALL) y = SMALL_WATERFALL;
+      uint16_t color = gray ? RGB565(y*255/SMALL_WATERFALL, y*255/SMALL_WATERFALL, y*255/SMALL_WATERFALL) : waterfall_color(y);
+      while (j * sweep_history.points < (i+1) * WIDTH)  // Scale waterfall to WIDTH points
+        spi_buffer[j++] = color;
+    }
+    ili9341_bulk(OFFSETX, line, w_width, 1);
+  }
+}
+#endif
 
 void
 plot_init(void)
@@ -3,6 +3,7 @@ import serial
 import numpy as np
 import pylab as pl
 import struct
+import zlib
 from serial.tools import list_ports
 
 VID = 0x0483 #1155
@@ -213,6 +214,103 @@ class NanoVNA:
         arr = 0xFF000000 + ((arr & 0xF800) >> 8) + ((arr & 0x07E0) << 5) + ((arr & 0x001F) << 19)
         return Image.frombuffer('RGBA', (320, 240), arr, 'raw', 'RGBA', 0, 1)
 
+    def stream(self, on = True, delta = False, quant = 1):
+        if delta:
+            self.send_command("stream delta %d\r" % quant)
+        else:
+            self.send_command("stream raw\r")
+        self.send_command("stream %s\r" % ("on" if on else "off"))
+
+    @staticmethod
+    def decode_stream_delta(data, points, quant = 1):
+        # zig-zag varint deltas of level/quant, first point relative to 0
+        values = []
+        value = 0
+        shift = 0
+        z = 0
+        for b in bytearray(data):
+            z |= (b & 0x7f) << shift
+            shift += 7
+            if b & 0x80:
+                continue
+            value += (z >> 1) ^ -(z & 1)
+            values.append(value * quant)
+            z = shift = 0
+        if len(values) != points:
+            raise IOError("stream delta data has %d points, expected %d" % (len(values), points))
+        return np.array(values) / 32.0
+
+    def fetch_stream_frame(self):
+        # resync on magic, header is followed by data (raw int16 dBm*32 per point or delta encoded) and crc32 over both
+        sync = b''
+        while sync != b'\xa5\x5a':
+            sync = (sync + self.serial.read(1))[-2:]
+        version, header_size = struct.unpack("<BB", self.serial.read(2))
+        header = b'\xa5\x5a' + struct.pack("<BB", version, header_size) + self.serial.read(header_size - 4)
+        seq, timestamp, start, stop, points, rbw_x10, attenuate_x2, dropped = struct.unpack_from("<IIIIHHhH", header, 4)
+        encoding, quant, data_size = 0, 1, points * 2
+        if version >= 3:
+            encoding, quant, data_size = struct.unpack_from("<BBH", header, 28)
+        data = self.serial.read(data_size)
+        crc, = struct.unpack("<I", self.serial.read(4))
+        if zlib.crc32(header + data) != crc:
+            raise IOError("stream frame %d crc error" % seq)
+        frame = dict(sequence=seq, timestamp=timestamp, start=start, stop=stop, rbw=rbw_x10 / 10.0, attenuation=attenuate_x2 / 2.0, dropped=dropped)
+        frame['frequencies'] = np.linspace(start, stop, points)
+        if encoding == 1:
+            frame['level'] = self.decode_stream_delta(data, points, quant)
+        else:
+            frame['level'] = np.array(struct.unpack("<%dh" % points, data)) / 32.0
+        return frame
+
+    def fetch_history(self):
+        # header, rows oldest first and crc32 over both, each row is timestamp, reference and step followed by packed points
+        self.send_command("history dump\r")
+        header = self.serial.read(20)
+        magic, version, header_size, start, stop, points, row_size, bits, rows = struct.unpack_from("<HBBIIHHBB", header)
+        if magic != 0x5aa7:
+            raise IOError("history dump magic %x" % magic)
+        data = self.serial.read(rows * row_size)
+        crc, = struct.unpack("<I", self.serial.read(4))
+        if zlib.crc32(header + data) & 0xffffffff != crc:
+            raise IOError("history dump crc error")
+        self.fetch_data()
+        return self.decode_history(data, rows, row_size, points, bits), np.linspace(start, stop, points)
+
+    @staticmethod
+    def decode_history(data, rows, row_size, points, bits = 4):
+        # returns rows x points levels in dBm, oldest row first
+        q_max = (1 << bits) - 1
+        levels = []
+        for r in range(rows):
+            row = data[r * row_size:(r + 1) * row_size]
+            timestamp, ref, step = struct.unpack_from("<IhH", row)
+            packed = bytearray(row[8:])
+            if bits == 8:
+                q = packed[:points]
+            else:
+                q = [(packed[i >> 1] >> ((i & 1) * 4)) & 0x0f for i in range(points)]
+            levels.append([(ref - (q_max - v) * step) / 32.0 for v in q])
+        return np.array(levels)
+
+    def job_submit(self, start, stop, points = None, rbw = None, attenuation = None):
+        # returns job id, rbw in kHz and attenuation in dB, None is auto
+        if points is None:
+            self.fetch_frequencies()
+            points = len(self._frequencies)
+        self.send_command("job %d %d %d %s %s\r" % (start, stop, points, rbw or "auto", "auto" if attenuation is None else attenuation))
+        return int(self.fetch_data().split()[0])
+
+    def job_status(self, id):
+        self.send_command("job status %d\r" % id)
+        return self.fetch_data().split()[0]
+
+    def job_fetch(self, id):
+        self.send_command("job fetch %d\r" % id)
+        frame = self.fetch_stream_frame()
+        self.fetch_data()
+        return frame
+
     def logmag(self, x):
         pl.grid(True)
         pl.xlim(self.frequencies[0], self.frequencies[-1])
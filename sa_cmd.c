@@ -225,7 +225,7 @@ VNA_SHELL_FUNCTION(cmd_leveloffset)
       config.high_level_offset = v;
     else
       goto usage;
-    dirty = true;
+    dirty |= DIRTY_CORRECTION;
   } else {
   usage:
     shell_printf("leveloffset [low|high] [<offset>]\r\n");
@@ -712,7 +712,7 @@ VNA_SHELL_FUNCTION(cmd_scanraw)
     streamPut(shell_stream, 'x');
     streamPut(shell_stream, (uint8_t)(val & 0xFF));
     streamPut(shell_stream, (uint8_t)((val>>8) & 0xFF));
-    if ((i & 0x07) == 0) {  // if required
+    if ((i & 0x07) == 0 && !HEADLESS()) {  // if required
       int pos = i * (WIDTH+1) / points;
       ili9341_set_background(LCD_SWEEP_LINE_COLOR);
       ili9341_fill(OFFSETX, CHART_BOTTOM+1, pos, 1);     // update sweep progress bar
@@ -721,8 +721,10 @@ VNA_SHELL_FUNCTION(cmd_scanraw)
     }
 
   }
-  ili9341_set_background(LCD_BG_COLOR);
-  ili9341_fill(OFFSETX, CHART_BOTTOM+1, WIDTH, 1);
+  if (!HEADLESS()) {
+    ili9341_set_background(LCD_BG_COLOR);
+    ili9341_fill(OFFSETX, CHART_BOTTOM+1, WIDTH, 1);
+  }
   streamPut(shell_stream, '}');
   setting.frequency_step = old_step;
   dirty = true;
@@ -741,6 +743,597 @@ VNA_SHELL_FUNCTION(cmd_caloutput)
     set_refer_output(m - 1);
 }
 
+#ifdef __BENCH__
+VNA_SHELL_FUNCTION(cmd_bench)
+{
+  static const char * const bench_stage[BENCH_MAX] = {"lo", "settle", "rssi", "trace", "post", "plot"};
+  uint32_t us[BENCH_MAX] = {0};
+  int count = 4;
+  int draw = argc > 0 && get_str_index(argv[0], "draw") == 0;
+  if (draw) {                                                   // bench draw [frames]: full screen draw_all
+    argc--;
+    argv++;
+  }
+  if (argc > 1 || (argc == 1 && (count = my_atoi(argv[0])) <= 0)) {
+    shell_printf("usage: bench [sweeps]|draw [frames]\r\n");
+    return;
+  }
+  SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;                      // Free running 24 bit down counter at CPU clock
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+  if (draw) {
+    uint32_t draw_us = 0;
+    for (int n = 0; n < count; n++) {
+      redraw_request |= REDRAW_AREA;
+      BENCH_BEGIN(t);
+      draw_all(true);
+      draw_us += ((t - SysTick->VAL) & SysTick_LOAD_RELOAD_Msk) / (STM32_SYSCLK / 1000000);
+    }
+    SysTick->CTRL = 0;
+    int cells = ((area_width + CELLWIDTH - 1) / CELLWIDTH) * ((area_height + CELLHEIGHT - 1) / CELLHEIGHT);
+    shell_printf("%d frames %dus/frame %dus/cell\r\n", count, draw_us / count, draw_us / count / cells);
+    return;
+  }
+  sweep(false);                                                 // Warm up, apply all pending settings
+  uint32_t writes_issued = SI4432_writes_issued;
+  uint32_t writes_suppressed = SI4432_writes_suppressed;
+  systime_t time = chVTGetSystemTimeX();
+  for (int n = 0; n < count; n++) {
+    memset(bench_ticks, 0, sizeof bench_ticks);
+    sweep(false);
+    BENCH_BEGIN(t);
+    plot_into_index(measured);
+    BENCH_END(t, BENCH_PLOT);
+    for (int i = 0; i < BENCH_MAX; i++)                         // Fold into us after each sweep to avoid tick overflow
+      us[i] += bench_ticks[i] / (STM32_SYSCLK / 1000000);
+  }
+  time = chVTGetSystemTimeX() - time;
+  SysTick->CTRL = 0;
+  uint32_t points = count * sweep_points;
+  shell_printf("rbw %d.%dkHz", actual_rbw_x10/10, actual_rbw_x10%10);
+#ifdef __REFINE_SWEEP__
+  if (refine_active)
+    shell_printf(" fine %d.%dkHz", refine_rbw_x10/10, refine_rbw_x10%10);
+#endif
+  shell_printf(" span %uHz points %d spur %d step %d repeat %d\r\n",
+               get_sweep_frequency(ST_SPAN), sweep_points,
+               S_STATE(setting.spur_removal), setting.step_delay_mode, setting.repeat);
+  shell_printf("%d sweeps %dus/sweep\r\n", count, time * 100 / count);
+  shell_printf("si4432 writes %d/sweep suppressed %d/sweep\r\n",
+               (SI4432_writes_issued - writes_issued) / count, (SI4432_writes_suppressed - writes_suppressed) / count);
+  for (int i = 0; i < BENCH_MAX; i++) {
+    uint32_t p = us[i] * 100 / points;
+    shell_printf("%-6s %8dus/sweep %5d.%02dus/point\r\n", bench_stage[i], us[i] / count, p / 100, p % 100);
+  }
+}
+#endif
+
+
+#ifdef __ADAPTIVE_SETTLE__
+VNA_SHELL_FUNCTION(cmd_settle)
+{
+  if (argc == 0) {
+    uint32_t sum = 0, min = 255, max = 0;
+    for (int i = 0; i < sweep_points; i++) {
+      uint32_t v = settle_time[i];
+      sum += v;
+      if (v < min) min = v;
+      if (v > max) max = v;
+    }
+    shell_printf("tolerance %d ceiling %dus settle min %dus avg %dus max %dus\r\n", SI4432_settle_tolerance, SI4432_step_delay,
+                 min * SETTLE_TIME_UNIT, sum * SETTLE_TIME_UNIT / sweep_points, max * SETTLE_TIME_UNIT);
+    return;
+  }
+  if (argc == 1 && strcmp(argv[0], "dump") == 0) {
+    for (int i = 0; i < sweep_points; i++)
+      shell_printf("%d\r\n", settle_time[i] * SETTLE_TIME_UNIT);
+    return;
+  }
+  int t;
+  if (argc != 1 || (t = my_atoi(argv[0])) < 0 || t > 20) {
+    shell_printf("usage: settle [dump|0-20]\r\n");
+    return;
+  }
+  SI4432_settle_tolerance = t;
+}
+#endif
+
+#ifdef __REFINE_SWEEP__
+VNA_SHELL_FUNCTION(cmd_refine)
+{
+  if (argc == 0) {
+    shell_printf("refine %s", refine_sweep ? "on" : "off");
+    if (refine_active)
+      shell_printf(" coarse %d.%dkHz fine %d.%dkHz", actual_rbw_x10/10, actual_rbw_x10%10, refine_rbw_x10/10, refine_rbw_x10%10);
+    shell_printf("\r\n");
+    return;
+  }
+  int m = generic_option_cmd("refine", "off|on", argc, argv[0]);
+  if (m>=0) {
+    refine_sweep = m;
+    dirty = true;
+  }
+}
+#endif
+
+#ifdef __SI4432_BUS_MOCK__
+VNA_SHELL_FUNCTION(cmd_bus)
+{
+  if (argc == 0) {
+    shell_printf("writes %d reads %d pe4302 %d\r\n", bus_mock_writes, bus_mock_reads, bus_mock_pe4302);
+    return;
+  }
+  int c = my_atoi(argv[0]);
+  if (argc != 1 || c < 0 || c >= MAX_SI4432) {
+    shell_printf("usage: bus [0-%d]\r\n", MAX_SI4432-1);
+    return;
+  }
+  for (int i = 0; i < 0x80; i++)
+    shell_printf("%02x%s", bus_mock_reg[c][i], (i & 0x0F) == 0x0F ? "\r\n" : " ");
+}
+#endif
+
+#ifdef __SWEEP_STREAM__
+// Binary sweep stream frame, all fields little endian
+// header, data, crc32 (zlib) over header and data
+// Raw data is int16 pureRSSI_t (dBm * 32) per point. Delta data is the level divided by the quantization step,
+// sent as zig-zag varint of the difference to the previous point (first point relative to 0)
+// The sweep thread only copies finished sweeps into a small ring, the stream thread drains it to the host.
+// If the host falls behind the sweep is dropped, visible as a sequence gap and in the dropped counter.
+#define SWEEP_STREAM_MAGIC    0x5AA5
+#define SWEEP_STREAM_VERSION  3
+#define SWEEP_STREAM_RAW      0
+#define SWEEP_STREAM_DELTA    1
+#define SWEEP_STREAM_BUFFERS  2                               // one in transfer, one ready, 608 bytes each
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  header_size;
+  uint32_t sequence;                                          // Counts every completed sweep, including dropped ones
+  uint32_t timestamp;                                         // System ticks (100us) at start of sweep
+  freq_t   start;
+  freq_t   stop;
+  uint16_t points;
+  uint16_t rbw_x10;
+  int16_t  attenuate_x2;
+  uint16_t dropped;                                           // Total sweeps dropped since stream on
+  uint8_t  encoding;                                          // SWEEP_STREAM_RAW or SWEEP_STREAM_DELTA
+  uint8_t  quant;                                             // Delta quantization step in 1/32dB, 1 is lossless
+  uint16_t data_size;                                         // Bytes of data following the header
+} sweep_stream_header_t;
+
+typedef struct {
+  sweep_stream_header_t header;
+  pureRSSI_t data[POINTS_COUNT];
+} sweep_stream_frame_t;
+
+static sweep_stream_frame_t sweep_stream_ring[SWEEP_STREAM_BUFFERS];
+static volatile uint8_t sweep_stream_head;                    // Written only by sweep thread
+static volatile uint8_t sweep_stream_tail;                    // Written only by stream thread
+static uint32_t sweep_stream_sequence;
+static uint32_t sweep_stream_sent;
+static uint16_t sweep_stream_dropped;
+static uint8_t sweep_stream_encoding = SWEEP_STREAM_RAW;
+static uint8_t sweep_stream_quant = 1;
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, int len)
+{
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// Returns encoded size or -1 if it does not fit, noisy traces can need up to 3 bytes per point
+static int sweep_stream_encode_delta(uint8_t *out, int max, int quant)
+{
+  int32_t prev = 0;
+  int n = 0;
+  for (int i = 0; i < sweep_points; i++) {
+    int32_t v = float_TO_PURE_RSSI(actual_t[i]);
+    if (quant > 1)                                            // Round to nearest step
+      v = (v >= 0 ? v + quant/2 : v - quant/2) / quant;
+    uint32_t d = v - prev;
+    prev = v;
+    uint32_t z = (d << 1) ^ -(d >> 31);                       // Zig-zag, small negative and positive deltas stay small
+    do {
+      if (n >= max)
+        return -1;
+      uint8_t b = z & 0x7F;
+      z >>= 7;
+      out[n++] = z ? b | 0x80 : b;
+    } while (z);
+  }
+  return n;
+}
+
+// Fill frame from the last sweep in actual_t
+static void sweep_stream_fill(sweep_stream_frame_t *frame, uint32_t sequence)
+{
+  frame->header.magic        = SWEEP_STREAM_MAGIC;
+  frame->header.version      = SWEEP_STREAM_VERSION;
+  frame->header.header_size  = sizeof(sweep_stream_header_t);
+  frame->header.sequence     = sequence;
+  frame->header.timestamp    = start_of_sweep_timestamp;
+  frame->header.start        = get_sweep_frequency(ST_START);
+  frame->header.stop         = get_sweep_frequency(ST_STOP);
+  frame->header.points       = sweep_points;
+  frame->header.rbw_x10      = actual_rbw_x10;
+  frame->header.attenuate_x2 = setting.attenuate_x2;
+  frame->header.dropped      = sweep_stream_dropped;
+  frame->header.encoding     = SWEEP_STREAM_RAW;
+  frame->header.quant        = 1;
+  int size = -1;
+  if (sweep_stream_encoding == SWEEP_STREAM_DELTA)
+    size = sweep_stream_encode_delta((uint8_t *)frame->data, sizeof(frame->data), sweep_stream_quant);
+  if (size >= 0) {
+    frame->header.encoding   = SWEEP_STREAM_DELTA;
+    frame->header.quant      = sweep_stream_quant;
+  } else {                                                    // Raw, or delta would be larger
+    for (int i = 0; i < sweep_points; i++)
+      frame->data[i] = float_TO_PURE_RSSI(actual_t[i]);
+    size = sweep_points * sizeof(pureRSSI_t);
+  }
+  frame->header.data_size    = size;
+}
+
+static void sweep_stream_send(sweep_stream_frame_t *frame)
+{
+  int size = sizeof(sweep_stream_header_t) + frame->header.data_size;
+  uint32_t crc = crc32(0, (uint8_t *)frame, size);
+  streamWrite(shell_stream, (uint8_t *)frame, size);
+  streamWrite(shell_stream, (uint8_t *)&crc, sizeof(crc));
+}
+
+static void sweep_stream_push(void)
+{
+  uint32_t sequence = sweep_stream_sequence++;
+  if ((uint8_t)(sweep_stream_head - sweep_stream_tail) >= SWEEP_STREAM_BUFFERS) {  // Host is behind, do not stall sweep
+    sweep_stream_dropped++;
+    return;
+  }
+  sweep_stream_fill(&sweep_stream_ring[sweep_stream_head % SWEEP_STREAM_BUFFERS], sequence);
+  sweep_stream_head++;
+}
+
+static THD_WORKING_AREA(waStreamThread, 256);
+static THD_FUNCTION(StreamThread, arg)
+{
+  (void)arg;
+  chRegSetThreadName("stream");
+  while (1) {
+    if (sweep_stream_tail == sweep_stream_head) {
+      chThdSleepMilliseconds(5);
+      continue;
+    }
+    sweep_stream_send(&sweep_stream_ring[sweep_stream_tail % SWEEP_STREAM_BUFFERS]);
+    sweep_stream_sent++;
+    sweep_stream_tail++;
+  }
+}
+
+VNA_SHELL_FUNCTION(cmd_stream)
+{
+  static bool started = false;
+  static const char cmd[] = "off|on|raw|delta";
+  if (argc == 0) {
+    shell_printf("sequence %d sent %d dropped %d encoding %s quant %d\r\n", sweep_stream_sequence, sweep_stream_sent, sweep_stream_dropped,
+                 sweep_stream_encoding == SWEEP_STREAM_DELTA ? "delta" : "raw", sweep_stream_quant);
+    return;
+  }
+  int m = get_str_index(argv[0], cmd);
+  int quant = 1;
+  if (m < 0 || argc > 2 || (argc == 2 && (m != 3 || (quant = my_atoi(argv[1])) < 1 || quant > 255))) {
+    shell_printf("usage: stream %s [quant 1-255]\r\n", cmd);
+    return;
+  }
+  if (m >= 2) {
+    sweep_stream_encoding = (m == 3 ? SWEEP_STREAM_DELTA : SWEEP_STREAM_RAW);
+    sweep_stream_quant = quant;
+    return;
+  }
+  if (m && !started) {
+    chThdCreateStatic(waStreamThread, sizeof(waStreamThread), NORMALPRIO, StreamThread, NULL);
+    started = true;
+  }
+  sweep_stream_sequence = 0;
+  sweep_stream_sent = 0;
+  sweep_stream_dropped = 0;
+  sweep_stream = m;
+}
+#endif
+
+#ifdef __SCAN_JOBS__
+#ifndef __SWEEP_STREAM__
+#error "__SCAN_JOBS__ needs __SWEEP_STREAM__ for the result frame format"
+#endif
+// Scan jobs are queued by the host and run by the sweep thread ahead of the normal sweep, each with its
+// own start/stop/points/rbw/attenuation. The user settings are restored after every job sweep, but the
+// job sweep replaces the actual trace so averaging, min/max hold and decay of the user sweep restart.
+// A finished job keeps its result as a stream frame (sequence = job id) until fetched, jobs stay queued
+// while all result buffers are full so the host decides how far ahead it submits.
+#define SCAN_JOBS         4
+#define SCAN_JOB_RESULTS  2                                   // 608 bytes each
+#define SCAN_JOB_AUTO     (-1)
+
+enum { JOB_FREE, JOB_QUEUED, JOB_RUNNING, JOB_DONE };
+
+typedef struct {
+  uint16_t id;
+  uint8_t  state;
+  uint8_t  result;                                            // Index in scan_job_frame when JOB_DONE
+  freq_t   start;
+  freq_t   stop;
+  uint16_t points;
+  uint16_t rbw_x10;                                           // 0 is auto
+  int8_t   attenuate;                                         // dB or SCAN_JOB_AUTO
+} scan_job_t;
+
+static scan_job_t scan_job[SCAN_JOBS];
+static sweep_stream_frame_t scan_job_frame[SCAN_JOB_RESULTS];
+static uint8_t scan_job_frame_used;                           // Bit per result buffer
+static uint16_t scan_job_id;
+
+// Oldest queued job, ids wrap around
+static scan_job_t *scan_job_next(void)
+{
+  scan_job_t *next = NULL;
+  for (int i = 0; i < SCAN_JOBS; i++) {
+    if (scan_job[i].state == JOB_QUEUED && (next == NULL || (int16_t)(scan_job[i].id - next->id) < 0))
+      next = &scan_job[i];
+  }
+  return next;
+}
+
+static scan_job_t *scan_job_find(uint16_t id)
+{
+  for (int i = 0; i < SCAN_JOBS; i++) {
+    if (scan_job[i].state != JOB_FREE && scan_job[i].id == id)
+      return &scan_job[i];
+  }
+  return NULL;
+}
+
+static bool scan_job_ready(void)
+{
+  if (scan_job_frame_used == (1 << SCAN_JOB_RESULTS) - 1)    // Wait till host fetches a result
+    return false;
+  return scan_job_next() != NULL;
+}
+
+static void scan_job_run(void)
+{
+  scan_job_t *job = scan_job_next();
+  int r = 0;
+  while (scan_job_frame_used & (1 << r))
+    r++;
+  // Save user sweep settings
+  freq_t frequency0 = setting.frequency0;
+  freq_t frequency1 = setting.frequency1;
+  int freq_mode = setting.freq_mode;
+  uint16_t points = sweep_points;
+  uint32_t rbw_x10 = setting.rbw_x10;
+  int auto_attenuation = setting.auto_attenuation;
+  int16_t attenuate_x2 = setting.attenuate_x2;
+  int atten_step = setting.atten_step;
+
+  job->state = JOB_RUNNING;
+  set_sweep_frequency(ST_START, job->start);
+  set_sweep_frequency(ST_STOP, job->stop);
+  set_sweep_points(job->points);
+  set_RBW(job->rbw_x10);
+  if (job->attenuate == SCAN_JOB_AUTO)
+    set_auto_attenuation();
+  else
+    set_attenuation(job->attenuate);
+  sweep(false);
+  sweep_stream_fill(&scan_job_frame[r], job->id);
+  scan_job_frame[r].header.dropped = 0;
+  scan_job_frame_used |= 1 << r;
+  job->result = r;
+  job->state = JOB_DONE;
+
+  setting.frequency0 = frequency0;
+  setting.frequency1 = frequency1;
+  setting.freq_mode = freq_mode;
+  sweep_points = points;
+  setting.auto_attenuation = auto_attenuation;
+  setting.attenuate_x2 = attenuate_x2;
+  setting.atten_step = atten_step;
+  update_frequencies();
+  set_RBW(rbw_x10);
+  dirty |= DIRTY_ALL;               // Attenuation was restored directly, PE4302 and switch only set in full setup
+}
+
+VNA_SHELL_FUNCTION(cmd_job)
+{
+  static const char cmd[] = "list|status|fetch|cancel";
+  static const char *state[] = {"free", "queued", "running", "done"};
+  if (argc == 0)
+    goto usage;
+  int m = get_str_index(argv[0], cmd);
+  if (m >= 0) {
+    if (argc > 2 || (m != 0 && argc != 2))
+      goto usage;
+    if (m == 0) {
+      for (int i = 0; i < SCAN_JOBS; i++)
+        if (scan_job[i].state != JOB_FREE)
+          shell_printf("%d %s\r\n", scan_job[i].id, state[scan_job[i].state]);
+      return;
+    }
+    scan_job_t *job = scan_job_find(my_atoui(argv[1]));
+    if (m == 1) {
+      shell_printf("%s\r\n", job ? state[job->state] : "none");
+      return;
+    }
+    if (job == NULL || (m == 2 && job->state != JOB_DONE)) {
+      shell_printf("job %s %s\r\n", argv[1], job ? "not done" : "not found");
+      return;
+    }
+    if (job->state == JOB_DONE) {
+      if (m == 2)
+        sweep_stream_send(&scan_job_frame[job->result]);
+      scan_job_frame_used &= ~(1 << job->result);
+    }
+    job->state = JOB_FREE;
+    return;
+  }
+  if (argc < 2)
+    goto usage;
+  if (MODE_OUTPUT(setting.mode)) {
+    shell_printf("job needs input mode\r\n");
+    return;
+  }
+  freq_t start = my_atoui(argv[0]);
+  freq_t stop = my_atoui(argv[1]);
+  uint32_t points = sweep_points;
+  uint32_t rbw = 0;
+  int attenuate = SCAN_JOB_AUTO;
+  if (start > stop) {
+    shell_printf("frequency range is invalid\r\n");
+    return;
+  }
+  if (argc >= 3 && ((points = my_atoui(argv[2])) < 2 || points > POINTS_COUNT))
+    goto usage;
+  if (argc >= 4 && get_str_index(argv[3], "auto|0") < 0 && ((rbw = my_atoui(argv[3])) < 2 || rbw > 600))
+    goto usage;
+  if (argc >= 5 && get_str_index(argv[4], "auto") < 0 && ((attenuate = my_atoui(argv[4])) > 31))
+    goto usage;
+  scan_job_t *job = NULL;
+  for (int i = 0; i < SCAN_JOBS; i++)
+    if (scan_job[i].state == JOB_FREE) { job = &scan_job[i]; break; }
+  if (job == NULL) {
+    shell_printf("job queue full\r\n");
+    return;
+  }
+  if (++scan_job_id == 0)                                    // 0 never used as id
+    scan_job_id = 1;
+  job->id = scan_job_id;
+  job->start = start;
+  job->stop = stop;
+  job->points = points;
+  job->rbw_x10 = rbw * 10;
+  job->attenuate = attenuate;
+  job->state = JOB_QUEUED;
+  shell_printf("%d\r\n", job->id);
+  return;
+usage:
+  shell_printf("usage: job {start(Hz)} {stop(Hz)} [points] [rbw 2..600|auto] [attenuation 0..31|auto]\r\n"
+               "       job %s [id]\r\n"
+               "each job sweep restarts averaging and min/max hold of the user sweep\r\n", cmd);
+}
+#endif
+
+#ifdef __SWEEP_HISTORY__
+#ifndef __SWEEP_STREAM__
+#error "__SWEEP_HISTORY__ needs __SWEEP_STREAM__ for crc32"
+#endif
+// Binary history dump, all fields little endian
+// header, rows oldest first (sweep_history_row_t and packed points, row_size bytes each), crc32 (zlib) over all
+#define SWEEP_HISTORY_MAGIC    0x5AA7
+#define SWEEP_HISTORY_VERSION  1
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  header_size;
+  freq_t   start;
+  freq_t   stop;
+  uint16_t points;
+  uint16_t row_size;
+  uint8_t  bits;
+  uint8_t  rows;
+  uint16_t reserved;
+} sweep_history_header_t;
+
+VNA_SHELL_FUNCTION(cmd_history)
+{
+  static const char cmd[] = "clear|bits|replay|dump";
+  if (argc == 0) {
+    shell_printf("bits %d rows %d capacity %d points %d\r\n", sweep_history.bits, sweep_history.rows,
+                 sweep_history.capacity, sweep_history.points);
+    return;
+  }
+  int m = get_str_index(argv[0], cmd);
+  int bits = 0;
+  if (m < 0 || (m == 1 && (argc != 2 || ((bits = my_atoi(argv[1])) != 4 && bits != 8))) ||
+      (m == 2 && argc == 2 && get_str_index(argv[1], "gray") < 0) || (m != 1 && m != 2 && argc != 1)) {
+    shell_printf("usage: history [clear|bits 4|8|replay [gray]|dump]\r\n");
+    return;
+  }
+  switch (m) {
+  case 0:
+    sweep_history_clear(sweep_history.bits);
+    break;
+  case 1:
+    sweep_history_clear(bits);
+    break;
+  case 2:
+    sweep_history_replay(argc == 2);
+    break;
+  case 3: {
+    sweep_history_header_t header = {
+      .magic = SWEEP_HISTORY_MAGIC,
+      .version = SWEEP_HISTORY_VERSION,
+      .header_size = sizeof(sweep_history_header_t),
+      .start = sweep_history.start,
+      .stop = sweep_history.stop,
+      .points = sweep_history.points,
+      .row_size = sweep_history.row_size,
+      .bits = sweep_history.bits,
+      .rows = sweep_history.rows,
+    };
+    uint32_t crc = crc32(0, (uint8_t *)&header, sizeof(header));
+    streamWrite(shell_stream, (uint8_t *)&header, sizeof(header));
+    for (int n = sweep_history.rows - 1; n >= 0; n--) {
+      uint8_t *row = (uint8_t *)sweep_history_row(n);
+      crc = crc32(crc, row, sweep_history.row_size);
+      streamWrite(shell_stream, row, sweep_history.row_size);
+    }
+    streamWrite(shell_stream, (uint8_t *)&crc, sizeof(crc));
+    break;
+  }
+  }
+}
+#endif
+
+#ifdef __HEADLESS__
+VNA_SHELL_FUNCTION(cmd_headless)
+{
+  static const char cmd[] = "off|on";
+  int m;
+  if (argc == 0) {
+    shell_printf("%s\r\n", config.headless ? "on" : "off");
+    return;
+  }
+  if (argc != 1 || (m = get_str_index(argv[0], cmd)) < 0) {
+    shell_printf("usage: headless [%s]\r\n", cmd);
+    return;
+  }
+  if (m != config.headless)
+    set_headless(m);
+}
+
+VNA_SHELL_FUNCTION(cmd_stat)
+{
+  static const char *mode[] = {"screen", "headless"};
+  (void)argc;
+  (void)argv;
+  for (int i = 0; i < 2; i++) {
+    if (cycle_ticks[i] == 0)
+      continue;
+    // ticks * 8 of 100us
+    shell_printf("%s: sweep %dms cycle %dms %.2f sweeps/s\r\n", mode[i], sweep_ticks[i] / 80, cycle_ticks[i] / 80,
+                 (float)(8 * CH_CFG_ST_FREQUENCY) / cycle_ticks[i]);
+  }
+  if (cycle_ticks[0] && cycle_ticks[1])
+    shell_printf("headless gain: %d%%\r\n", (int)(cycle_ticks[0] * 100 / cycle_ticks[1]) - 100);
+}
+#endif
 
 #pragma GCC pop_options
 
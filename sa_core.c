@@ -37,7 +37,19 @@ setting_t setting;
 freq_t frequencies[POINTS_COUNT];
 
 uint16_t actual_rbw_x10 = 0;
+#ifdef __BENCH__
+uint32_t bench_ticks[BENCH_MAX];
+#endif
 uint16_t vbwSteps = 1;
+#ifdef __REFINE_SWEEP__
+// Refine sweep: full sweep at a coarse wide RBW, then re-measure only around the peaks at the requested RBW
+static bool refine_sweep = false;       // Enabled by user
+static bool refine_active = false;      // Enabled and useful with current settings
+static uint16_t refine_rbw_x10;         // Requested RBW used around peaks
+static uint16_t refine_vbwSteps;
+static bool refine_pass = false;        // Re-measuring around peaks, the sweep plan does not apply
+#define REFINE_WIDTH    1               // Points re-measured on each side of a peak
+#endif
 freq_t minFreq = 0;
 freq_t maxFreq = 520000000;
 
@@ -235,7 +247,7 @@ void set_decay(int d)
     d = (float)d * 500.0 * (float)sweep_points / (float)setting.actual_sweep_time_us;
   }
   setting.decay = d;
-  dirty = true;
+  dirty |= DIRTY_AVERAGE;
 }
 
 #ifdef __QUASI_PEAK__
@@ -247,7 +259,7 @@ void set_attack(int d)
     d = (float)d * 500.0 * (float)sweep_points  / (float)setting.actual_sweep_time_us;
   }
   setting.attack = d;
-  dirty = true;
+  dirty |= DIRTY_AVERAGE;
 }
 #endif
 
@@ -256,7 +268,7 @@ void set_noise(int d)
   if (d < 2 || d > 50)
     return;
   setting.noise = d;
-  dirty = true;
+  dirty |= DIRTY_DISPLAY;
 }
 
 void set_gridlines(int d)
@@ -265,7 +277,7 @@ void set_gridlines(int d)
     return;
   config.gridlines = d;
   config_save();
-  dirty = true;
+  dirty |= DIRTY_DISPLAY;
   update_grid();
 }
 
@@ -277,10 +289,21 @@ void set_10mhz(freq_t f)
     return;
   config.setting_frequency_10mhz = f;
   config_save();
-  dirty = true;
+  dirty |= DIRTY_LO;
   update_grid();
 }
 
+#ifdef __HEADLESS__
+void set_headless(int h)
+{
+  config.headless = h;
+  config_save();
+  redraw_frame();
+  if (!h)
+    redraw_request |= REDRAW_AREA | REDRAW_CAL_STATUS | REDRAW_FREQUENCY | REDRAW_BATTERY;
+}
+#endif
+
 void set_measurement(int m)
 {
   setting.measurement = m;
@@ -350,7 +373,7 @@ void toggle_tracking_output(void)
 void toggle_mirror_masking(void)
 {
   setting.mirror_masking = !setting.mirror_masking;
-  dirty = true;
+  dirty |= DIRTY_LO;
 }
 
 void toggle_mute(void)
@@ -362,7 +385,8 @@ void toggle_mute(void)
 void toggle_hambands(void)
 {
   config.hambands = !config.hambands;
-  dirty = true;
+  dirty |= DIRTY_DISPLAY;
+  update_grid();
 }
 
 void toggle_below_IF(void)
@@ -403,7 +427,7 @@ void set_IF(int f)
   if (f == 0)
     setting.auto_IF = true;
   setting.frequency_IF = f;
-  dirty = true;
+  dirty |= DIRTY_LO;
 }
 
 #ifdef TINYSA4
@@ -444,8 +468,8 @@ void set_auto_attenuation(void)
   } else {
     setting.attenuate_x2 = 0;
   }
+  dirty |= (setting.atten_step ? DIRTY_ALL : DIRTY_ATTENUATION);   // Switch only set in full setup
   setting.atten_step = false;
-  dirty = true;
 }
 
 void set_auto_reflevel(int v)
@@ -508,6 +532,7 @@ float get_level(void)
 }
 void set_attenuation(float a)       // Is used both in low output mode and high/low input mode
 {
+  int atten_step = setting.atten_step;
   if (setting.mode == M_GENLOW) {
     a = a + POWER_OFFSET;
     if (a > 6) {                // +9dB
@@ -540,7 +565,7 @@ void set_attenuation(float a)       // Is used both in low output mode and high/
     } else
       setting.atten_step = 0;
     setting.auto_attenuation = false;
-    dirty = true;
+    dirty |= (setting.atten_step == atten_step ? DIRTY_ATTENUATION : DIRTY_ALL);   // Switch only set in full setup
   }
   if (a<0.0)
       a = 0;
@@ -551,7 +576,7 @@ void set_attenuation(float a)       // Is used both in low output mode and high/
   if (setting.attenuate_x2 == a*2)
     return;
   setting.attenuate_x2 = a*2;
-  dirty = true;
+  dirty |= (setting.mode == M_GENLOW ? DIRTY_ALL : DIRTY_ATTENUATION);  // Output level also sets drive
 }
 
 void set_storage(void)
@@ -615,7 +640,7 @@ void set_actual_power(float o)              // Set peak level to known value
     config.low_level_offset = new_offset;
 #endif
   }
-  dirty = true;
+  dirty |= DIRTY_CORRECTION;
   config_save();
   // dirty = true;             // No HW update required, only status panel refresh
 }
@@ -648,7 +673,7 @@ void set_RBW(uint32_t rbw_x10)
 {
   setting.rbw_x10 = rbw_x10;
   update_rbw();
-  dirty = true;
+  dirty |= DIRTY_RBW;
 }
 
 #ifdef __SPUR__
@@ -659,7 +684,7 @@ void set_spur(int v)
   setting.spur_removal = v;
 //  if (setting.spur_removal && actual_rbw > 360)           // moved to update_rbw
 //    set_RBW(300);
-  dirty = true;
+  dirty |= DIRTY_LO;
 }
 
 void toggle_spur(void)
@@ -679,7 +704,7 @@ void toggle_spur(void)
   else
     setting.spur_removal = S_ON;
 #endif
-  dirty = true;
+  dirty |= DIRTY_LO;
 }
 #endif
 
@@ -701,9 +726,17 @@ void set_harmonic(int h)
 void set_step_delay(int d)                  // override RSSI measurement delay or set to one of three auto modes
 {
 
-  if ((3 <= d && d < 100) || d > 30000)         // values 0 (normal scan), 1 (precise scan) and 2(fast scan) have special meaning and are auto calculated
+  if (((3 <= d && d < 100) || d > 30000)         // values 0 (normal scan), 1 (precise scan) and 2(fast scan) have special meaning and are auto calculated
+#ifdef __ADAPTIVE_SETTLE__
+      && d != SD_ADAPTIVE                        // 4 (adaptive scan) uses the auto calculated delay as ceiling
+#endif
+      )
     return;
-  if (d <3) {
+  if (d <3
+#ifdef __ADAPTIVE_SETTLE__
+      || d == SD_ADAPTIVE
+#endif
+      ) {
     setting.step_delay_mode = d;
     setting.step_delay = 0;
     setting.offset_delay = 0;
@@ -711,13 +744,13 @@ void set_step_delay(int d)                  // override RSSI measurement delay o
     setting.step_delay_mode = SD_MANUAL;
     setting.step_delay = d;
   }
-  dirty = true;
+  dirty |= DIRTY_RBW;
 }
 
 void set_offset_delay(int d)                  // override RSSI measurement delay or set to one of three auto modes
 {
  setting.offset_delay = d;
- dirty = true;
+ dirty |= DIRTY_RBW;
 }
 
 
@@ -936,7 +969,7 @@ void set_offset(float offset)
   }
   plot_printf(low_level_help_text, sizeof low_level_help_text, "%+d..%+d", min + (int)offset, max + (int)offset);
   force_set_markmap();
-  dirty = true;             // No HW update required, only status panel refresh but need to ensure the cached value is updated in the calculation of the RSSI
+  dirty |= DIRTY_CORRECTION;  // No HW update required, only status panel refresh but need to ensure the cached value is updated in the calculation of the RSSI
 }
 
 void set_trigger_level(float trigger_level)
@@ -988,7 +1021,7 @@ void set_mode(int m)
 void set_fast_speedup(int s)
 {
   setting.fast_speedup = s;
-  dirty = true;
+  dirty |= DIRTY_RBW;
 }
 
 void calculate_step_delay(void)
@@ -1035,15 +1068,20 @@ void calculate_step_delay(void)
   }
 }
 
-void apply_settings(void)       // Ensure all settings in the setting structure are translated to the right HW setup
+static void apply_attenuation(void)
 {
-  set_switches(setting.mode);
 #ifdef __PE4302__
   if (setting.mode == M_HIGH)
     PE4302_Write_Byte(40);  // Ensure defined input impedance of low port when using high input mode (power calibration)
   else
     PE4302_Write_Byte((int)(setting.attenuate_x2));
 #endif
+}
+
+void apply_settings(void)       // Ensure all settings in the setting structure are translated to the right HW setup
+{
+  set_switches(setting.mode);
+  apply_attenuation();
   if (setting.mode == M_LOW) {
 
   }
@@ -1392,6 +1430,24 @@ void update_rbw(void)           // calculate the actual_rbw and the vbwSteps (#
     setting.vbw_x10 = actual_rbw_x10;
     vbwSteps = 1;               // only one vbwSteps
   }
+#ifdef __REFINE_SWEEP__
+  refine_active = false;
+  if (refine_sweep && setting.frequency_step > 0 && MODE_INPUT(setting.mode) && !setting.tracking
+      && setting.average == AV_OFF && setting.trigger == T_AUTO) {
+    freq_t coarse_rbw_x10 = 4*setting.vbw_x10;        // Wide enough for a single step per point
+    if (coarse_rbw_x10 > 6000)
+      coarse_rbw_x10 = 6000;
+    if (S_STATE(setting.spur_removal) && coarse_rbw_x10 > 3000)
+      coarse_rbw_x10 = 2500;
+    if (coarse_rbw_x10 > actual_rbw_x10) {
+      refine_rbw_x10 = actual_rbw_x10;
+      refine_vbwSteps = vbwSteps;
+      actual_rbw_x10 = set_rbw(coarse_rbw_x10);
+      vbwSteps = 1;
+      refine_active = true;
+    }
+  }
+#endif
 }
 
 int binary_search_frequency(int f)      // Search which index in the frequency tabled matches with frequency  f using actual_rbw
@@ -1572,6 +1628,22 @@ int avoid_spur(int f)                   // find if this frequency should be avoi
   return binary_search(f);
 }
 
+// Sweep plan: LO/IF decisions per point recorded on the first pass after settings change and
+// replayed while not dirty, so spur table search and 48MHz clock trim decision are done only once
+#define PLAN_ALT_IF         0x01                // Use spur_alternate_IF
+#define PLAN_BELOW_48MHZ    0x02                // Clock trim below 48MHz to avoid 72MHz spur
+static uint8_t sweep_plan[(POINTS_COUNT+3)/4];  // 2 bit per point
+#define PLAN_SHIFT(i)       (((i)&3)*2)
+#define PLAN_GET(i)         ((sweep_plan[(i)>>2] >> PLAN_SHIFT(i)) & 3)
+#define PLAN_SET(i, f)      (sweep_plan[(i)>>2] |= (f) << PLAN_SHIFT(i))
+#define PLAN_CLEAR(i)       (sweep_plan[(i)>>2] &= ~(3 << PLAN_SHIFT(i)))
+static uint16_t sweep_plan_count = 0;           // Number of recorded points, plan complete when equal to sweep_points
+
+#ifdef __ADAPTIVE_SETTLE__
+#define SETTLE_TIME_UNIT    50                  // Recorded settle time resolution in uS
+static uint8_t settle_time[POINTS_COUNT];       // Longest settle time of the last sweep per point in SETTLE_TIME_UNIT
+#endif
+
 static int modulation_counter = 0;
 
 #define MODULATION_STEPS    8
@@ -1601,6 +1673,7 @@ static const int fm_modulation_offset[4] =
 
 
 deviceRSSI_t age[POINTS_COUNT];     // Array used for 1: calculating the age of any max and 2: buffer for fast sweep RSSI values;
+static avgRSSI_t average_t[POINTS_COUNT];  // Min, max, decay and average state of actual_t, so the sweep does no float math on it
 
 static float old_a = -150;          // cached value to reduce writes to level registers
 static pureRSSI_t correct_RSSI;
@@ -1654,9 +1727,21 @@ pureRSSI_t perform(bool break_on_operation, int i, freq_t f, int tracking)     /
   int modulation_delay = 0;
   int modulation_index = 0;
   int spur_second_pass = false;
-  if (i == 0 && dirty ) {                                                        // if first point in scan and dirty
-    calculate_correction();                                                 // pre-calculate correction factor dividers to avoid float division
-    apply_settings();                                                       // Initialize HW
+  if (i == 0 && (dirty & DIRTY_SETUP)) {                                     // if first point in scan and dirty
+    if (dirty & (DIRTY_ALL|DIRTY_CORRECTION))
+      calculate_correction();                                               // pre-calculate correction factor dividers to avoid float division
+    if (dirty & DIRTY_ALL)
+      apply_settings();                                                     // Initialize HW
+    else {                                                                  // Only the parts that changed
+      if (dirty & DIRTY_ATTENUATION)
+        apply_attenuation();
+      if (dirty & (DIRTY_LO|DIRTY_RBW)) {
+        update_rbw();
+        calculate_step_delay();
+      }
+    }
+    if (dirty & (DIRTY_ALL|DIRTY_LO|DIRTY_RBW))
+      sweep_plan_count = 0;                                                 // Record new sweep plan
     scandirty = true;                                                       // This is the first pass with new settings
     dirty = false;
     sweep_elapsed = chVTGetSystemTimeX();                              // for measuring accumulated time
@@ -1822,6 +1907,25 @@ modulation_again:
 #ifdef __DEBUG_SPUR__                 // For debugging the spur avoidance control
   stored_t[i] = -90.0;                                  // Display when to do spur shift in the stored trace
 #endif
+  // Sweep plan only when each point is measured once with the LO directly on the requested frequency
+  int plan_replay = false;
+  int plan_record = false;
+  if (setting.mode == M_LOW && !tracking && vbwSteps == 1 && !S_STATE(setting.spur_removal) && !in_selftest && f == frequencies[i]
+#ifdef __REFINE_SWEEP__
+      && !refine_pass                           // Recorded at the coarse RBW, spur avoidance depends on RBW
+#endif
+      ) {
+    if (sweep_plan_count == sweep_points)
+      plan_replay = true;
+    else {
+      if (i == 0)
+        sweep_plan_count = 0;                   // Restart recording after aborted sweep
+      if (sweep_plan_count == i) {
+        plan_record = true;
+        PLAN_CLEAR(i);
+      }
+    }
+  }
   int t = 0;
   do {
     freq_t lf = f;
@@ -1862,7 +1966,9 @@ modulation_again:
           lf = reffer_freq[setting.refer];
 #endif
         } else {
-          if(!in_selftest && avoid_spur(lf)) {         // check if alternate IF is needed to avoid spur.
+          if(!in_selftest && (plan_replay ? (PLAN_GET(i) & PLAN_ALT_IF) : avoid_spur(lf))) {         // check if alternate IF is needed to avoid spur.
+            if (plan_record)
+              PLAN_SET(i, PLAN_ALT_IF);
             local_IF = spur_alternate_IF;
 #ifdef __DEBUG_SPUR__                 // For debugging the spur avoidance control
             stored_t[i] = -60.0;                                       // Display when to do spur shift in the stored trace
@@ -1938,6 +2044,9 @@ modulation_again:
 #if 1               // No 72MHz spur avoidance yet
         if (setting.mode == M_LOW && !in_selftest /* && !(SDU1.config->usbp->state == USB_ACTIVE) */ ) {         // Avoid 72MHz spur
           int set_below = false;
+          if (plan_replay)
+            set_below = PLAN_GET(i) & PLAN_BELOW_48MHZ;
+          else {
 #ifdef TINYSA4
           if (lf < 40000000) {
             uint32_t tf = lf;
@@ -1952,6 +2061,12 @@ modulation_again:
             if (tf < 20000000 )
               set_below = true;
           }
+          if (plan_record) {
+            if (set_below)
+              PLAN_SET(i, PLAN_BELOW_48MHZ);
+            sweep_plan_count++;
+          }
+          }
           if (set_below) {     // If below 48MHz
             if (!is_below) {
               clock_below_48MHz();
@@ -2078,6 +2193,14 @@ modulation_again:
     {
 #ifdef __SI4432__
       pureRSSI = SI4432_RSSI(lf, MODE_SELECT(setting.mode));            // Get RSSI, either from pre-filled buffer
+#endif
+#ifdef __ADAPTIVE_SETTLE__
+      if (i < POINTS_COUNT) {
+        int u = (SI4432_settle_us + SETTLE_TIME_UNIT - 1) / SETTLE_TIME_UNIT;
+        if (u > 255) u = 255;
+        if (t == 0 || settle_time[i] < u)
+          settle_time[i] = u;
+      }
 #endif
     }
 #ifdef __SPUR__
@@ -2114,7 +2237,8 @@ static int sweep_counter = 0;           // Only used for HW refresh
 // main loop for measurement
 static bool sweep(bool break_on_operation)
 {
-  float RSSI;
+  int32_t RSSI;                 // Per point pipeline is fixed point in pureRSSI_t units, float only when stored in the trace
+  int32_t peak_level;
   int16_t downslope;
 #ifdef __SI4432__
   uint32_t agc_peak_freq = 0;
@@ -2135,7 +2259,11 @@ static bool sweep(bool break_on_operation)
 #endif
   downslope = true;             // Initialize the peak search algorithm
   temppeakLevel = -150;
+  peak_level = float_TO_PURE_RSSI(-150);
   float temp_min_level = 100;
+  int32_t min_level_pure = float_TO_PURE_RSSI(100);
+  const int32_t noise = float_TO_PURE_RSSI(setting.noise);
+  const int32_t normalize = float_TO_PURE_RSSI(setting.normalize_level);
 
   //  spur_old_stepdelay = 0;
   //  shell_printf("\r\n");
@@ -2143,6 +2271,7 @@ static bool sweep(bool break_on_operation)
   modulation_counter = 0;                                             // init modulation counter in case needed
   int refreshing = false;
 
+  dirty &= DIRTY_SETUP;           // Display only changes are redrawn already
   if (dirty) {                    // Calculate new scanning solution
     sweep_counter = 0;
     if (get_sweep_frequency(ST_SPAN) < 300000)  // Check if AM signal
@@ -2170,12 +2299,13 @@ sweep_again:                                // stay in sweep loop when output mo
   for (int i = 0; i < sweep_points; i++) {
     // --------------------- measure -------------------------
 
-    RSSI = PURE_TO_float(perform(break_on_operation, i, frequencies[i], setting.tracking));    // Measure RSSI for one of the frequencies
+    RSSI = perform(break_on_operation, i, frequencies[i], setting.tracking);    // Measure RSSI for one of the frequencies
+    BENCH_BEGIN(t);
     // if break back to top level to handle ui operation
     if (refreshing)
       scandirty = false;
     if (break_on_operation && operation_requested) {                        // break loop if needed
-      if (setting.actual_sweep_time_us > ONE_SECOND_TIME && MODE_INPUT(setting.mode)) {
+      if (setting.actual_sweep_time_us > ONE_SECOND_TIME && MODE_INPUT(setting.mode) && !HEADLESS()) {
         ili9341_set_background(LCD_BG_COLOR);
         ili9341_fill(OFFSETX, CHART_BOTTOM+1, WIDTH, 1);                    // Erase progress bar
       }
@@ -2189,12 +2319,12 @@ sweep_again:                                // stay in sweep loop when output mo
 #ifdef __SI4432__
     if (!in_selftest && setting.mode == M_HIGH && S_IS_AUTO(setting.agc) && UNIT_IS_LOG(setting.unit)) {
 #define AGC_RSSI_THRESHOLD  (-55+get_attenuation())
-
-      if (RSSI > AGC_RSSI_THRESHOLD && RSSI > agc_prev_rssi) {
+      float f_RSSI = PURE_TO_float(RSSI);
+      if (f_RSSI > AGC_RSSI_THRESHOLD && f_RSSI > agc_prev_rssi) {
         agc_peak_freq = frequencies[i];
-        agc_peak_rssi = agc_prev_rssi = RSSI;
+        agc_peak_rssi = agc_prev_rssi = f_RSSI;
       }
-      if (RSSI < AGC_RSSI_THRESHOLD)
+      if (f_RSSI < AGC_RSSI_THRESHOLD)
         agc_prev_rssi = -150;
       freq_t delta_freq = frequencies[i] - agc_peak_freq;
       if (agc_peak_freq != 0 &&  delta_freq < 2000000) {
@@ -2218,7 +2348,7 @@ sweep_again:                                // stay in sweep loop when output mo
 
     if (MODE_INPUT(setting.mode)) {
 
-      if (setting.actual_sweep_time_us > ONE_SECOND_TIME && (i & 0x07) == 0) {  // if required
+      if (setting.actual_sweep_time_us > ONE_SECOND_TIME && (i & 0x07) == 0 && !HEADLESS()) {  // if required
     	int pos = i * (WIDTH+1) / sweep_points;
     	ili9341_set_background(LCD_SWEEP_LINE_COLOR);
         ili9341_fill(OFFSETX, CHART_BOTTOM+1, pos, 1);     // update sweep progress bar
@@ -2229,9 +2359,9 @@ sweep_again:                                // stay in sweep loop when output mo
       // ------------------------ do all RSSI calculations from CALC menu -------------------
 
       if (setting.average != AV_OFF)
-        temp_t[i] = RSSI;
+        temp_t[i] = PURE_TO_float(RSSI);
       if (setting.subtract_stored) {
-        RSSI = RSSI - stored_t[i] + setting.normalize_level;
+        RSSI = RSSI - (int32_t)float_TO_PURE_RSSI(stored_t[i]) + normalize;
       }
 #ifdef __SI4432__
 //#define __DEBUG_AGC__
@@ -2249,45 +2379,51 @@ sweep_again:                                // stay in sweep loop when output mo
         last_AGC_value = AGC_value;
       }
 #endif
-      if (scandirty || setting.average == AV_OFF) {             // Level calculations
+      int32_t avg;                                              // Level calculations
+      if (scandirty || setting.average == AV_OFF) {
         if (setting.average == AV_MAX_DECAY) age[i] = 0;
-        actual_t[i] = RSSI;
+        avg = PURE_TO_AVG_RSSI(RSSI);
       } else {
+        avg = average_t[i];
+        int32_t new_avg = PURE_TO_AVG_RSSI(RSSI);
         switch(setting.average) {
-        case AV_MIN:      if (actual_t[i] > RSSI) actual_t[i] = RSSI; break;
-        case AV_MAX_HOLD: if (actual_t[i] < RSSI) actual_t[i] = RSSI; break;
+        case AV_MIN:      if (avg > new_avg) avg = new_avg; break;
+        case AV_MAX_HOLD: if (avg < new_avg) avg = new_avg; break;
         case AV_MAX_DECAY:
-          if (actual_t[i] < RSSI) {
+          if (avg < new_avg) {
             age[i] = 0;
-            actual_t[i] = RSSI;
+            avg = new_avg;
           } else {
             if (age[i] > setting.decay)
-              actual_t[i] -= 0.5;
+              avg -= PURE_TO_AVG_RSSI(16);     // 0.5dB in 1/32dB steps, no float in the loop
             else
               age[i] += 1;
           }
           break;
-        case AV_4:  actual_t[i] = (actual_t[i]*3 + RSSI) / 4.0; break;
-        case AV_16: actual_t[i] = (actual_t[i]*15 + RSSI) / 16.0; break;
+        case AV_4:  avg = AVG_RSSI_STEP(avg, RSSI, 2); break;
+        case AV_16: avg = AVG_RSSI_STEP(avg, RSSI, 4); break;
 #ifdef __QUASI_PEAK__
         case AV_QUASI:
-          { static float old_RSSI = -150.0;
-          if (i == 0) old_RSSI = actual_t[sweep_points-1];
-          if (RSSI > old_RSSI && setting.attack > 1)
-             old_RSSI += (RSSI - old_RSSI)/setting.attack;
-          else if (RSSI < old_RSSI && setting.decay > 1)
-            old_RSSI += (RSSI - old_RSSI)/setting.decay;
+          { static int32_t old_avg;
+          if (i == 0) old_avg = average_t[sweep_points-1];
+          int32_t delta = new_avg - old_avg;
+          int div = delta > 0 ? setting.attack : setting.decay;
+          if (div > 1)
+            old_avg += (delta + (delta > 0 ? div/2 : -div/2)) / div;   // Rounded
           else
-            old_RSSI = RSSI;
-          actual_t[i] = old_RSSI;
+            old_avg = new_avg;
+          avg = old_avg;
           }
           break;
 #endif
         }
       }
+      average_t[i] = avg;
+      actual_t[i] = AVG_TO_float(avg);
+      int32_t level = AVG_TO_PURE_RSSI(avg);
 
-      if (temp_min_level > actual_t[i])   // Remember minimum
-        temp_min_level = actual_t[i];
+      if (min_level_pure > level)   // Remember minimum
+        min_level_pure = level;
 
       // --------------------------- find peak and add to peak table if found  ------------------------
 
@@ -2296,27 +2432,28 @@ sweep_again:                                // stay in sweep loop when output mo
       if (i == 0) {                                          // Prepare peak finding
         cur_max = 0;          // Always at least one maximum
         temppeakIndex = 0;
-        temppeakLevel = actual_t[i];
+        peak_level = level;
         max_index[0] = 0;
         downslope = true;
       }
       if (downslope) {                               // If in down slope peak finding
-        if (temppeakLevel > actual_t[i]) {           // Follow down
+        if (peak_level > level) {                    // Follow down
           temppeakIndex = i;                         // Latest minimum
-          temppeakLevel = actual_t[i];
-        } else if (temppeakLevel + setting.noise < actual_t[i] ) {    // Local minimum found
+          peak_level = level;
+        } else if (peak_level + noise < level ) {    // Local minimum found
           temppeakIndex = i;                         // This is now the latest maximum
-          temppeakLevel = actual_t[i];
+          peak_level = level;
           downslope = false;
         }
       } else {                                      // up slope peak finding
-        if (temppeakLevel < actual_t[i]) {    // Follow up
+        if (peak_level < level) {    // Follow up
           temppeakIndex = i;
-          temppeakLevel = actual_t[i];
-        } else if (actual_t[i] < temppeakLevel - setting.noise) {    // Local max found
+          peak_level = level;
+        } else if (level < peak_level - noise) {    // Local max found
 
           // maintain sorted peak table
           int j = 0;                                            // Insert max in sorted table
+          temppeakLevel = actual_t[temppeakIndex];
           while (j<cur_max && actual_t[max_index[j]] >= temppeakLevel)   // Find where to insert
             j++;
           if (j < MAX_MAX) {                                    // Larger then one of the previous found
@@ -2335,17 +2472,85 @@ sweep_again:                                // stay in sweep loop when output mo
           }
           // Insert done
           temppeakIndex = i;            // Latest minimum
-          temppeakLevel = actual_t[i];
+          peak_level = level;
 
           downslope = true;
         }
       }        // end of peak finding
     }           // end of input specific processing
+    BENCH_END(t, BENCH_TRACE);
   }  // ---------------------- end of sweep loop -----------------------------
 
   if (MODE_OUTPUT(setting.mode) && setting.modulation != MO_NONE ) // if in output mode with modulation
     goto sweep_again;                                             // Keep repeating sweep loop till user aborts by input
 
+#ifdef __REFINE_SWEEP__
+  // ---------------------- re-measure around peaks at requested RBW ----------------------------
+  if (refine_active) {
+    uint16_t coarse_rbw_x10 = actual_rbw_x10;
+#ifdef __SI4432__
+    SI4432_Sel = MODE_SELECT(setting.mode);
+#endif
+    actual_rbw_x10 = set_rbw(refine_rbw_x10);
+    vbwSteps = refine_vbwSteps;
+    calculate_step_delay();
+    calculate_static_correction();              // RSSI correction depends on the RBW
+    refine_pass = true;
+    for (int j = 0; j < cur_max; j++) {
+      int peak = max_index[j];
+      int from = peak - REFINE_WIDTH;
+      int to = peak + REFINE_WIDTH;
+      if (from < 0) from = 0;
+      if (to >= sweep_points) to = sweep_points - 1;
+      for (int k = from; k <= to; k++) {
+        RSSI = perform(break_on_operation, k, frequencies[k], setting.tracking);
+        if (break_on_operation && operation_requested)
+          break;
+        if (setting.subtract_stored)
+          RSSI = RSSI - (int32_t)float_TO_PURE_RSSI(stored_t[k]) + normalize;
+        average_t[k] = PURE_TO_AVG_RSSI(RSSI);
+        actual_t[k] = PURE_TO_float(RSSI);
+        if (actual_t[peak] < actual_t[k])       // Peak may move inside the refined region
+          peak = k;
+      }
+      max_index[j] = peak;
+      if (break_on_operation && operation_requested)
+        break;
+    }
+    for (int j = 1; j < cur_max; j++) {         // Close peaks can refine to the same maximum
+      int k = 0;
+      while (k < j && max_index[k] != max_index[j])
+        k++;
+      if (k < j) {
+        for (k = j; k < cur_max - 1; k++)
+          max_index[k] = max_index[k+1];
+        cur_max--;
+        j--;
+      }
+    }
+    for (int j = 1; j < cur_max; j++) {         // Refined levels can change the peak order
+      int16_t m = max_index[j];
+      int k = j;
+      for (; k > 0 && actual_t[max_index[k-1]] < actual_t[m]; k--)
+        max_index[k] = max_index[k-1];
+      max_index[k] = m;
+    }
+#ifdef __SI4432__
+    SI4432_Sel = MODE_SELECT(setting.mode);
+#endif
+    refine_pass = false;
+    actual_rbw_x10 = set_rbw(coarse_rbw_x10);  // Back to coarse for the next sweep
+    vbwSteps = 1;
+    calculate_step_delay();
+    calculate_static_correction();
+    if (break_on_operation && operation_requested)
+      return false;
+  }
+#endif
+
+  BENCH_BEGIN(t_post);
+  temp_min_level = PURE_TO_float(min_level_pure);
+
   // --------------- check if maximum is above trigger level -----------------
 
   if (setting.trigger != T_AUTO && setting.frequency_step > 0) {    // Trigger active
@@ -2358,7 +2563,7 @@ sweep_again:                                // stay in sweep loop when output mo
     }
 //    scandirty = true;                // To show trigger happened
   }
-  if (setting.actual_sweep_time_us > ONE_SECOND_TIME && MODE_INPUT(setting.mode)) {
+  if (setting.actual_sweep_time_us > ONE_SECOND_TIME && MODE_INPUT(setting.mode) && !HEADLESS()) {
     // ili9341_fill(OFFSETX, CHART_BOTTOM+1, WIDTH, 1, 0);     // Erase progress bar before updating actual_sweep_time
     ili9341_set_background(LCD_BG_COLOR);
     ili9341_fill(OFFSETX, CHART_BOTTOM+1, WIDTH, 1);
@@ -2432,6 +2637,7 @@ sweep_again:                                // stay in sweep loop when output mo
 //            mask_start = m;
           actual_t[m] = actual_t[m-1];
           actual_t[m+1] = actual_t[m-1];
+          average_t[m] = average_t[m+1] = average_t[m-1];
         }
 //        else {
 //          if (i == mask_start)
@@ -2748,6 +2954,7 @@ sweep_again:                                // stay in sweep loop when output mo
 #endif
   //    redraw_marker(peak_marker, FALSE);
   //  STOP_PROFILE;
+  BENCH_END(t_post, BENCH_POST);
 #ifdef TINYSA3
   palSetPad(GPIOB, GPIOB_LED);
 #endif
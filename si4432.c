@@ -22,6 +22,7 @@
 #include "hal.h"
 #include "nanovna.h"
 #include <math.h>
+#include <string.h>
 #include "si4432.h"
 
 #pragma GCC push_options
@@ -48,6 +49,113 @@
 //#define SI4432_log(X)   { if (log_index < MAXLOG)  SI4432_logging[log_index++] = X; }
 #define SI4432_log(X)
 
+//------------------------- SI4432/PE4302 bus ------------------------------
+// Three build time selectable backends providing shiftOut/shiftIn and chip select:
+//   default              - bit banged GPIO
+//   __SI4432_SPI__       - SPI2 peripheral
+//   __SI4432_BUS_MOCK__  - RAM register model, no radio board needed
+// SI_CS_HIGH must be used to end every transfer, it waits for the hardware to finish.
+
+#if defined(__SI4432_BUS_MOCK__)
+// Every chip select cycle is decoded as address byte + data bytes (burst, address auto increment)
+// Without a chip select the byte is latched by the PE4302
+uint8_t bus_mock_reg[MAX_SI4432][0x80];
+uint8_t bus_mock_pe4302;
+uint32_t bus_mock_writes, bus_mock_reads;
+static int8_t  mock_chip = -1;
+static int16_t mock_addr = -1;
+
+static void mock_select(uint16_t pin)
+{
+  mock_chip = (pin == GPIO_LO_SEL ? SI4432_LO : SI4432_RX);
+  mock_addr = -1;
+}
+
+static void shiftOut(uint8_t val)
+{
+  bus_mock_writes++;
+  if (mock_chip < 0) {
+    bus_mock_pe4302 = val;
+    return;
+  }
+  if (mock_addr < 0) {                                  // First byte is address, RW bit ignored
+    mock_addr = val & 0x7F;
+    return;
+  }
+  bus_mock_reg[mock_chip][mock_addr] = val;
+  mock_addr = (mock_addr + 1) & 0x7F;
+}
+
+static uint8_t shiftIn(void)
+{
+  uint8_t val = bus_mock_reg[mock_chip][mock_addr];
+  bus_mock_reads++;
+  if (mock_addr == SI4432_INT_STATUS2)                  // Chip always ready
+    val = 0x02;
+  else if (mock_addr == SI4432_DEV_STATUS) {            // Follow requested state: 1 = RX, 2 = TX
+    uint8_t state = bus_mock_reg[mock_chip][SI4432_STATE];
+    val = (state & 0x08) ? 2 : ((state & 0x04) ? 1 : 0);
+  }
+  mock_addr = (mock_addr + 1) & 0x7F;
+  return val;
+}
+
+#define SI_CS_LOW(pin)    mock_select(pin)
+#define SI_CS_HIGH(pin)   (mock_chip = -1)
+#define SI4432_BUS_FLUSH()
+
+#elif defined(__SI4432_SPI__)
+#include "spi.h"
+#define SI4432_SPI          SPI2
+#define SI4432_SPI_SPEED    SPI_BR_DIV8                 // 6MHz, SI4432 allows up to 10MHz
+// shiftOut only queues the byte, the 4 byte TX FIFO holds a complete register write
+// so the CPU only waits once before chip select is released
+
+static void SI4432_bus_init(void)
+{
+  rccEnableSPI2(FALSE);
+  SI4432_SPI->CR1 = 0;
+  SI4432_SPI->CR1 = SPI_CR1_MSTR      // SPI is MASTER, mode 0 same as bit banged bus
+                  | SPI_CR1_SSM       // Software slave management, chip selects are GPIO
+                  | SPI_CR1_SSI
+                  | SI4432_SPI_SPEED;
+  SI4432_SPI->CR2 = SPI_CR2_8BIT      // SPI data size, set to 8 bit
+                  | SPI_CR2_FRXTH;    // SPI_SR_RXNE generated every 8 bit data
+  SI4432_SPI->CR1|= SPI_CR1_SPE;
+  palSetPadMode(GPIOB, GPIO_SPI2_CLK, PAL_MODE_ALTERNATE(5) | PAL_STM32_OSPEED_HIGHEST);
+  palSetPadMode(GPIOB, GPIO_SPI2_SDO, PAL_MODE_ALTERNATE(0));
+  palSetPadMode(GPIOB, GPIO_SPI2_SDI, PAL_MODE_ALTERNATE(0) | PAL_STM32_OSPEED_HIGHEST);
+}
+
+static inline void SI4432_BUS_FLUSH(void)
+{
+  // Wait tx complete and drop Rx buffer
+  while (SPI_RX_IS_NOT_EMPTY(SI4432_SPI) || SPI_IS_BUSY(SI4432_SPI))
+    (void)SPI_READ_8BIT(SI4432_SPI);
+}
+
+static inline void shiftOut(uint8_t val)
+{
+  SPI_WRITE_8BIT(SI4432_SPI, val);
+}
+
+static uint8_t shiftIn(void)
+{
+  SI4432_BUS_FLUSH();                                   // Skip data received during address
+  SPI_WRITE_8BIT(SI4432_SPI, 0);
+  while (SPI_RX_IS_EMPTY(SI4432_SPI) || SPI_IS_BUSY(SI4432_SPI));
+  return SPI_READ_8BIT(SI4432_SPI);
+}
+
+#define SI_CS_LOW(pin)    palClearPad(GPIOC, pin)
+#define SI_CS_HIGH(pin)   do { SI4432_BUS_FLUSH(); palSetPad(GPIOC, pin); } while (0)
+
+#else
+
+#define SI_CS_LOW(pin)    palClearPad(GPIOC, pin)
+#define SI_CS_HIGH(pin)   palSetPad(GPIOC, pin)
+#define SI4432_BUS_FLUSH()
+
 static void shiftOut(uint8_t val)
 {
 //  SI4432_log(SI4432_Sel);
@@ -117,6 +225,7 @@ static void shiftOutBuf(uint8_t *buf, uint16_t size) {
   }while(--size);
 }
 #endif
+#endif
 
 #ifdef __SI4432__
 #define CS_SI0_HIGH     palSetPad(GPIOC, GPIO_RX_SEL)
@@ -135,52 +244,95 @@ volatile int SI4432_Sel = 0;         // currently selected SI4432
 // volatile int SI4432_guard = 0;
 
 #ifdef __SI4432_H__
+// Shadow of the last value written to every SI4432 register, rewriting an unchanged value is skipped.
+// Invalidated on reset and power cycle. The state register (write triggers action) and FIFO are never cached.
+static uint8_t SI4432_shadow[MAX_SI4432][0x80];
+static uint8_t SI4432_shadow_valid[MAX_SI4432][0x80/8];
+uint32_t SI4432_writes_issued = 0;
+uint32_t SI4432_writes_suppressed = 0;
+
+static void SI4432_shadow_invalidate(int s)
+{
+  memset(SI4432_shadow_valid[s], 0, sizeof(SI4432_shadow_valid[s]));
+}
+
+// Return true if register already holds DATA, else remember the new value
+static bool SI4432_shadow_hit(uint8_t ADR, uint8_t DATA)
+{
+  if (SI4432_Sel >= MAX_SI4432 || ADR == SI4432_STATE || ADR == SI4432_FIFO)
+    return false;
+  uint8_t *valid = &SI4432_shadow_valid[SI4432_Sel][ADR>>3];
+  uint8_t mask = 1<<(ADR&7);
+  if ((*valid & mask) && SI4432_shadow[SI4432_Sel][ADR] == DATA)
+    return true;
+  *valid |= mask;
+  SI4432_shadow[SI4432_Sel][ADR] = DATA;
+  return false;
+}
+
 #define SELECT_DELAY 10
 void SI4432_Write_Byte(uint8_t ADR, uint8_t DATA )
 {
+  if (SI4432_shadow_hit(ADR, DATA)) {
+    SI4432_writes_suppressed++;
+    return;
+  }
+  SI4432_writes_issued++;
 //  if (SI4432_guard)
 //    while(1) ;
 //  SI4432_guard = 1;
 //  SPI2_CLK_LOW;
-  palClearPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_LOW(SI_nSEL[SI4432_Sel]);
 //  chThdSleepMicroseconds(SELECT_DELAY);
   ADR |= 0x80 ; // RW = 1
   shiftOut( ADR );
   shiftOut( DATA );
-  palSetPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_HIGH(SI_nSEL[SI4432_Sel]);
 //  SI4432_guard = 0;
 }
 
 void SI4432_Write_2_Byte(uint8_t ADR, uint8_t DATA1, uint8_t DATA2)
 {
+  // Not short circuit, shadow of every register must be updated
+  if (SI4432_shadow_hit(ADR, DATA1) & SI4432_shadow_hit(ADR+1, DATA2)) {
+    SI4432_writes_suppressed++;
+    return;
+  }
+  SI4432_writes_issued++;
 //  if (SI4432_guard)
 //    while(1) ;
 //  SI4432_guard = 1;
 //  SPI2_CLK_LOW;
-  palClearPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_LOW(SI_nSEL[SI4432_Sel]);
 //  chThdSleepMicroseconds(SELECT_DELAY);
   ADR |= 0x80 ; // RW = 1
   shiftOut( ADR );
   shiftOut( DATA1 );
   shiftOut( DATA2 );
-  palSetPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_HIGH(SI_nSEL[SI4432_Sel]);
 //  SI4432_guard = 0;
 }
 
 void SI4432_Write_3_Byte(uint8_t ADR, uint8_t DATA1, uint8_t DATA2, uint8_t DATA3 )
 {
+  // Not short circuit, shadow of every register must be updated
+  if (SI4432_shadow_hit(ADR, DATA1) & SI4432_shadow_hit(ADR+1, DATA2) & SI4432_shadow_hit(ADR+2, DATA3)) {
+    SI4432_writes_suppressed++;
+    return;
+  }
+  SI4432_writes_issued++;
 //  if (SI4432_guard)
 //    while(1) ;
 //  SI4432_guard = 1;
 //  SPI2_CLK_LOW;
-  palClearPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_LOW(SI_nSEL[SI4432_Sel]);
 //  chThdSleepMicroseconds(SELECT_DELAY);
   ADR |= 0x80 ; // RW = 1
   shiftOut( ADR );
   shiftOut( DATA1 );
   shiftOut( DATA2 );
   shiftOut( DATA3 );
-  palSetPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_HIGH(SI_nSEL[SI4432_Sel]);
 //  SI4432_guard = 0;
 }
 
@@ -191,10 +343,10 @@ uint8_t SI4432_Read_Byte( uint8_t ADR )
 //    while(1) ;
 //  SI4432_guard = 1;
 //  SPI2_CLK_LOW;
-  palClearPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_LOW(SI_nSEL[SI4432_Sel]);
   shiftOut( ADR );
   DATA = shiftIn();
-  palSetPad(GPIOC, SI_nSEL[SI4432_Sel]);
+  SI_CS_HIGH(SI_nSEL[SI4432_Sel]);
 //  SI4432_guard = 0;
   return DATA ;
 }
@@ -208,6 +360,7 @@ void SI4432_Reset(void)
   SI4432_Read_Byte (SI4432_INT_STATUS2);
   // always perform a system reset (don't send 0x87)
   SI4432_Write_Byte(SI4432_STATE, 0x80);
+  SI4432_shadow_invalidate(SI4432_Sel);     // All registers back to default
   chThdSleepMilliseconds(10);
   // wait for chiprdy bit
   while (count++ < 100 && ( SI4432_Read_Byte (SI4432_INT_STATUS2) & 0x02 ) == 0) {
@@ -360,6 +513,7 @@ void SI4432_Set_Frequency ( freq_t Freq ) {
 
 //  Freq = (Freq / 1000 ) * 1000; // force freq to 1000 grid
 
+  BENCH_BEGIN(t);
   uint8_t hbsel;
   if (0) shell_printf("%d: Freq %q\r\n", SI4432_Sel, Freq);
   if (Freq >= 480000000U) {
@@ -369,8 +523,21 @@ void SI4432_Set_Frequency ( freq_t Freq ) {
     hbsel = 0;
   }
   uint8_t sbsel = 1 << 6;
-  uint32_t N = (Freq / config.setting_frequency_10mhz - 24)&0x1F;
-  uint32_t K = Freq % config.setting_frequency_10mhz;
+  // Successive points mostly stay in the same 10MHz band, remember it to skip the division (no divide on Cortex-M0)
+  static freq_t band_start[MAX_SI4432] = {(freq_t)~0, (freq_t)~0};  // Above any frequency, first call computes the band
+  static uint8_t band_N[MAX_SI4432];
+  static uint32_t band_10mhz = 0;
+  if (band_10mhz != config.setting_frequency_10mhz) {    // Calibration changed, invalidate both
+    band_10mhz = config.setting_frequency_10mhz;
+    band_start[SI4432_RX] = band_start[SI4432_LO] = (freq_t)~0;
+  }
+  if (Freq < band_start[SI4432_Sel] || Freq - band_start[SI4432_Sel] >= band_10mhz) {
+    uint32_t n = Freq / band_10mhz;
+    band_start[SI4432_Sel] = n * band_10mhz;
+    band_N[SI4432_Sel] = (n - 24)&0x1F;
+  }
+  uint32_t N = band_N[SI4432_Sel];
+  uint32_t K = Freq - band_start[SI4432_Sel];
   uint32_t Carrier = (K<<2) / 625;
   uint8_t Freq_Band = N | hbsel | sbsel;
 //  int count = 0;
@@ -403,6 +570,7 @@ void SI4432_Set_Frequency ( freq_t Freq ) {
   }
 #endif
   SI4432_frequency_changed = true;
+  BENCH_END(t, BENCH_LO);
 //  if (mode == 1)        // RX mode            Disabled as unreliable
 //    SI4432_Write_Byte( 0x07, 0x07);
 //  else
@@ -459,14 +627,14 @@ void SI4432_trigger_fill(int s, uint8_t trigger_lvl, int up_direction, int trigg
   else
     t_mode = T_DOWN_MASK;
   do {
-    palClearPad(GPIOC, sel);
+    SI_CS_LOW(sel);
     shiftOut(SI4432_REG_RSSI);
     if (operation_requested)                        // allow aborting a wait for trigger
       return;                                                           // abort
     // Store data level bitfield (remember only last 2 states)
     // T_LEVEL_UNDEF mode bit drop after 2 shifts
     rssi = shiftIn();
-    palSetPad(GPIOC, sel);
+    SI_CS_HIGH(sel);
     age[i] = rssi;
     i++;
     if (i >= sweep_points)
@@ -541,10 +709,10 @@ void SI4432_Fill(int s, int start)
   SPI2_CLK_LOW;
   int i = start;
   do {
-    palClearPad(GPIOC, sel);
+    SI_CS_LOW(sel);
     shiftOut(SI4432_REG_RSSI);
     age[i]=(char)shiftIn();
-    palSetPad(GPIOC, sel);
+    SI_CS_HIGH(sel);
     if (++i >= sweep_points) break;
     if (t)
       my_microsecond_delay(t);
@@ -567,6 +735,41 @@ pureRSSI_t getSI4432_RSSI_correction(void){
   return SI4432_RSSI_correction;
 };
 
+#ifdef __ADAPTIVE_SETTLE__
+/*
+ * Adaptive settle: instead of always waiting the table delay poll the RSSI and stop when
+ * ADAPTIVE_STABLE consecutive readings are within tolerance of each other.
+ * The table delay is used as ceiling, the achieved wait is returned
+ */
+#define ADAPTIVE_MIN_WAIT   100                 // Always wait this long after offset change, RSSI register lags
+#define ADAPTIVE_STABLE     2                   // Number of consecutive readings within tolerance
+uint8_t SI4432_settle_tolerance = 2;            // In device units of 0.5dB
+uint16_t SI4432_settle_us = 0;                  // Settle time of the last RSSI measurement
+
+static int SI4432_adaptive_settle(int min_wait, int max_delay)
+{
+  int poll = max_delay >> 3;                     // RSSI update rate follows the RBW, so does the table delay
+  if (poll < 20)
+    poll = 20;
+  int waited = min_wait;
+  my_microsecond_delay(min_wait);
+  int last = SI4432_Read_Byte(SI4432_REG_RSSI);
+  int stable = 0;
+  while (waited < max_delay) {
+    my_microsecond_delay(poll);
+    waited += poll;
+    int v = SI4432_Read_Byte(SI4432_REG_RSSI);
+    int d = v - last;
+    last = v;
+    if (d < -SI4432_settle_tolerance || d > SI4432_settle_tolerance)
+      stable = 0;
+    else if (++stable >= ADAPTIVE_STABLE)
+      break;
+  }
+  return waited;
+}
+#endif
+
 pureRSSI_t SI4432_RSSI(uint32_t i, int s)
 {
   (void) i;
@@ -591,6 +794,9 @@ pureRSSI_t SI4432_RSSI(uint32_t i, int s)
 #endif
   SI4432_Sel = s;
   int stepdelay = SI4432_step_delay;
+#ifdef __ADAPTIVE_SETTLE__
+  int min_wait = (SI4432_frequency_changed ? MINIMUM_WAIT_FOR_RSSI : ADAPTIVE_MIN_WAIT);
+#endif
   if (SI4432_frequency_changed) {
     if (stepdelay < MINIMUM_WAIT_FOR_RSSI) {
       stepdelay = MINIMUM_WAIT_FOR_RSSI;
@@ -601,24 +807,36 @@ pureRSSI_t SI4432_RSSI(uint32_t i, int s)
     stepdelay = SI4432_offset_delay;
     SI4432_offset_changed = false;
   }
+  BENCH_BEGIN(t);
+#ifdef __ADAPTIVE_SETTLE__
+  if (setting.step_delay_mode == SD_ADAPTIVE && stepdelay > min_wait)
+    stepdelay = SI4432_adaptive_settle(min_wait, stepdelay);
+  else
+#endif
   if (stepdelay)
     my_microsecond_delay(stepdelay);
     // chThdSleepMicroseconds(SI4432_step_delay);
-  i = setting.repeat;
+#ifdef __ADAPTIVE_SETTLE__
+  SI4432_settle_us = stepdelay;
+#endif
+  BENCH_END(t, BENCH_SETTLE);
+  BENCH_BEGIN(t_read);
+  int repeat = setting.repeat;
   RSSI_RAW  = 0;
   do{
     RSSI_RAW += DEVICE_TO_PURE_RSSI((deviceRSSI_t)SI4432_Read_Byte(SI4432_REG_RSSI));
-    if (--i == 0) break;
+    if (--repeat == 0) break;
     my_microsecond_delay(100);
   }while(1);
 
   if (setting.repeat > 1)
     RSSI_RAW = RSSI_RAW / setting.repeat;
+  BENCH_END(t_read, BENCH_RSSI);
  //   if (MODE_INPUT(setting.mode) && RSSI_RAW == 0)
  //     SI4432_Init();
 #ifdef __SIMULATION__
-#error "Fixme!!! add correct simulation in pureRSSI_t type"
-  RSSI_RAW = Simulated_SI4432_RSSI(i,s);
+  // Simulated level is in dBm, convert back to device scale so the normal correction path applies
+  RSSI_RAW = float_TO_PURE_RSSI(Simulated_SI4432_RSSI(i,s)) - SI4432_RSSI_correction;
 #endif
 //STOP_PROFILE
   // Serial.println(dBm,2);
@@ -644,7 +862,8 @@ static uint8_t SI4432_init_script[] =
   SI4432_AGC_OVERRIDE, 0x60, // AGC, no LNA, fast gain increment
   SI4432_GPIO0_CONF, 0x12, // Normal
   SI4432_GPIO1_CONF, 0x15,
-  SI4432_GPIO2_CONF, 0x1F
+  SI4432_GPIO2_CONF, 0x1F,
+  0                          // End of script
 };
 
 
@@ -671,6 +890,9 @@ void SI4432_Sub_Init(void)
 
 void SI4432_Init()
 {
+#ifdef __SI4432_SPI__
+  SI4432_bus_init();
+#endif
 #if 1
 
   CS_SI0_LOW;                       // Drop CS so power can be removed
@@ -680,6 +902,8 @@ void SI4432_Init()
   SPI2_SDI_LOW;                     // will be set with any data out
 
   palClearPad(GPIOB, GPIO_RF_PWR);  // Drop power
+  SI4432_shadow_invalidate(SI4432_RX);
+  SI4432_shadow_invalidate(SI4432_LO);
   chThdSleepMilliseconds(10);      // Wait
   palSetPad(GPIOB, GPIO_RF_PWR);    // Restore power
   CS_SI0_HIGH;                      // And set chip select lines back to inactive
@@ -752,6 +976,7 @@ bool PE4302_Write_Byte(unsigned char DATA )
 //  PE4302_shiftOut(DATA);
 
   shiftOut(DATA);
+  SI4432_BUS_FLUSH();
 //  chThdSleepMicroseconds(PE4302_DELAY);
   CS_PE_HIGH;
 //  chThdSleepMicroseconds(PE4302_DELAY);
@@ -774,33 +999,32 @@ void PE4302_init(void) {}
 #endif
 
 #ifdef __SIMULATION__
-unsigned long seed = 123456789;
-extern float actual_rbw;
+static uint32_t seed = 123456789;
 float myfrand(void)
 {
-  seed = (unsigned int) (1103515245 * seed + 12345) ;
+  seed = 1103515245 * seed + 12345;
   return ((float) seed) / 1000000000.0;
 }
 #define NOISE  ((myfrand()-2) * 2)  // +/- 4 dBm noise
-extern int settingAttenuate;
 
 //#define LEVEL(i, f, v) (v * (1-(fabs(f - frequencies[i])/actual_rbw/1000)))
 
 float LEVEL(uint32_t i, freq_t f, int v)
 {
   float dv;
+  float rbw = actual_rbw_x10 * 100.0;         // RBW in Hz
   float df = fabs((float)f - (float)i);
-  if (df < actual_rbw*1000)
-    dv = df/(actual_rbw*1000);
+  if (df < rbw)
+    dv = df/rbw;
   else
-    dv =  1 + 50*(df - actual_rbw*1000)/(actual_rbw*1000);
-  return (v - dv - settingAttenuate);
+    dv =  1 + 50*(df - rbw)/rbw;
+  return (v - dv - setting.attenuate_x2/2.0);
 }
 
 float Simulated_SI4432_RSSI(uint32_t i, int s)
 {
   SI4432_Sel = s;
-  float v = -100 + log10(actual_rbw)*10 + NOISE;
+  float v = -100 + log10(actual_rbw_x10/10.0)*10 + NOISE;
   if(s == 0) {
     v = fmax(LEVEL(i,10000000,-20),v);
     v = fmax(LEVEL(i,20000000,-40),v);
@@ -24,6 +24,10 @@
 
 extern int SI4432_step_delay;
 extern int SI4432_offset_delay;
+#ifdef __ADAPTIVE_SETTLE__
+extern uint8_t SI4432_settle_tolerance;
+extern uint16_t SI4432_settle_us;
+#endif
 #ifdef __SI4432__
 
 //
@@ -129,6 +133,13 @@ pureRSSI_t SI4432_RSSI(uint32_t i, int s);
 #ifdef __SIMULATION__
 float Simulated_SI4432_RSSI(uint32_t i, int s);
 #endif
+extern uint32_t SI4432_writes_issued;
+extern uint32_t SI4432_writes_suppressed;
+#ifdef __SI4432_BUS_MOCK__
+extern uint8_t bus_mock_reg[MAX_SI4432][0x80];
+extern uint8_t bus_mock_pe4302;
+extern uint32_t bus_mock_writes, bus_mock_reads;
+#endif
 void SI4432_Set_Frequency ( uint32_t Freq );
 
 uint16_t force_rbw(int i);
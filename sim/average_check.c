@@ -0,0 +1,97 @@
+/*
+ * Host check of the fixed point trace averaging against the float reference.
+ *
+ * Feeds random level sequences through AVG_RSSI_STEP() (AV_4 and AV_16) and
+ * through the float average the sweep used before, fails when the two differ
+ * by more than the rounding bound of the fixed point state, then times both
+ * per point. Run with "make sim-check".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "nanovna.h"
+
+#define SEQUENCES  100000
+#define SWEEPS     64
+#define BENCH_RUNS 2000
+
+static uint32_t seed = 12345;
+static uint32_t rnd(void)
+{
+  seed = seed * 1664525U + 1013904223U;
+  return seed >> 8;
+}
+
+// Level in 1/32dB, a carrier or noise floor with some jitter, or a level jump
+static pureRSSI_t rnd_level(pureRSSI_t base)
+{
+  if ((rnd() & 15) == 0)
+    return float_TO_PURE_RSSI(-150) + (int)(rnd() % float_TO_PURE_RSSI(160));
+  return base + (int)(rnd() % 257) - 128;
+}
+
+static int check(int shift)
+{
+  int n = 1 << shift;
+  float bound = n * 0.5f / (32 << AVG_FRACTION_BITS) + 0.001f;     // Rounding error of one step accumulated by the average
+  float max_err = 0;
+  for (int s = 0; s < SEQUENCES; s++) {
+    pureRSSI_t base = float_TO_PURE_RSSI(-140) + (int)(rnd() % float_TO_PURE_RSSI(140));
+    pureRSSI_t rssi = rnd_level(base);
+    avgRSSI_t avg = PURE_TO_AVG_RSSI(rssi);
+    float ref = PURE_TO_float(rssi);
+    for (int k = 1; k < SWEEPS; k++) {
+      rssi = rnd_level(base);
+      avg = AVG_RSSI_STEP(avg, rssi, shift);
+      ref = (ref * (n - 1) + PURE_TO_float(rssi)) / n;
+      float err = fabsf(AVG_TO_float(avg) - ref);
+      if (err > max_err)
+        max_err = err;
+    }
+  }
+  printf("AV_%-2d max difference %.4fdB, bound %.4fdB: %s\n", n, max_err, bound, max_err <= bound ? "ok" : "FAIL");
+  return max_err <= bound;
+}
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static pureRSSI_t bench_rssi[POINTS_COUNT];
+static float      bench_actual[POINTS_COUNT];
+static avgRSSI_t  bench_average[POINTS_COUNT];
+
+static void bench(int shift)
+{
+  int n = 1 << shift;
+  for (int i = 0; i < POINTS_COUNT; i++) {
+    bench_rssi[i] = rnd_level(float_TO_PURE_RSSI(-80));
+    bench_actual[i] = PURE_TO_float(bench_rssi[i]);
+    bench_average[i] = PURE_TO_AVG_RSSI(bench_rssi[i]);
+  }
+  double t0 = now_ns();
+  for (int r = 0; r < BENCH_RUNS; r++)
+    for (int i = 0; i < POINTS_COUNT; i++)
+      bench_actual[i] = (bench_actual[i] * (n - 1) + PURE_TO_float(bench_rssi[i])) / n;
+  double t1 = now_ns();
+  for (int r = 0; r < BENCH_RUNS; r++)
+    for (int i = 0; i < POINTS_COUNT; i++) {
+      bench_average[i] = AVG_RSSI_STEP(bench_average[i], bench_rssi[i], shift);
+      bench_actual[i] = AVG_TO_float(bench_average[i]);
+    }
+  double t2 = now_ns();
+  printf("AV_%-2d host float %.2fns/point, fixed %.2fns/point\n", n,
+         (t1 - t0) / BENCH_RUNS / POINTS_COUNT, (t2 - t1) / BENCH_RUNS / POINTS_COUNT);
+}
+
+int main(void)
+{
+  int ok = check(2) & check(4);
+  bench(2);
+  bench(4);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ * Host simulation of the ChibiOS/RT kernel subset used by the tinySA firmware.
+ *
+ * Threads are POSIX threads that run one at a time: the running thread owns
+ * the kernel lock and gives it up only where a ChibiOS thread would block
+ * (sleep, suspend, polled delay, shell input), so the firmware sees the same
+ * cooperative order as on the single core target.
+ */
+#ifndef SIM_CH_H
+#define SIM_CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "chconf.h"
+
+#define TRUE  1
+#define FALSE 0
+
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef int32_t  msg_t;
+typedef int32_t  cnt_t;
+typedef uint32_t eventmask_t;
+typedef uint8_t  tprio_t;
+typedef void tfunc_t(void *);
+
+typedef struct { void *sp; } ctx_t;
+
+typedef struct ch_thread {
+  void             *wabase;
+  ctx_t             ctx;
+  int               refs;
+  tprio_t           prio;
+  int               state;
+  const char       *name;
+  struct ch_thread *next;
+  /* Simulation only */
+  tfunc_t          *func;
+  void             *arg;
+  volatile bool     woken;
+  msg_t             rdymsg;
+} thread_t;
+
+typedef thread_t *thread_reference_t;
+
+typedef struct { int locked; } mutex_t;
+
+#define THD_WORKING_AREA(s, n)  uint8_t s[n]
+#define THD_FUNCTION(tname, arg) void tname(void *arg)
+
+#define NORMALPRIO      128
+#define HIGHPRIO        255
+
+#define MSG_OK          0
+#define MSG_TIMEOUT     -1
+#define MSG_RESET       -2
+
+#define TIME_IMMEDIATE  ((sysinterval_t)0)
+#define TIME_INFINITE   ((sysinterval_t)-1)
+#define TIME_MS2I(msecs) ((sysinterval_t)(((uint64_t)(msecs) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define TIME_US2I(usecs) ((sysinterval_t)(((uint64_t)(usecs) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define MS2ST(msecs)     TIME_MS2I(msecs)
+
+#define CH_KERNEL_VERSION      "host simulation"
+#define PORT_COMPILER_NAME     "GCC " __VERSION__
+#define PORT_ARCHITECTURE_NAME "host"
+#define PORT_CORE_VARIANT_NAME "posix"
+#define PORT_INFO              "pthreads, cooperative"
+#define PLATFORM_NAME          "Linux"
+#define CH_DBG_STACK_FILL_VALUE 0x55
+#define CH_STATE_NAMES         "READY", "CURRENT", "SUSPENDED", "SLEEPING"
+
+void chSysInit(void);
+static inline void chSysLock(void) {}
+static inline void chSysUnlock(void) {}
+static inline void chSysLockFromISR(void) {}
+static inline void chSysUnlockFromISR(void) {}
+
+systime_t chVTGetSystemTimeX(void);
+#define chVTGetSystemTime() chVTGetSystemTimeX()
+
+void chThdSleep(sysinterval_t time);
+#define chThdSleepMilliseconds(msec) chThdSleep(TIME_MS2I(msec))
+#define chThdSleepMicroseconds(usec) chThdSleep(TIME_US2I(usec))
+#define osalThreadSleepMilliseconds(msec) chThdSleepMilliseconds(msec)
+#define osalThreadSleepMicroseconds(usec) chThdSleepMicroseconds(usec)
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+thread_t *chThdGetSelfX(void);
+msg_t chThdWait(thread_t *tp);
+msg_t chThdSuspendS(thread_reference_t *trp);
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, sysinterval_t timeout);
+void chThdResumeI(thread_reference_t *trp, msg_t msg);
+#define chThdResumeS(trp, msg) chThdResumeI(trp, msg)
+#define chThdResume(trp, msg)  chThdResumeI(trp, msg)
+
+void chRegSetThreadName(const char *name);
+thread_t *chRegFirstThread(void);
+thread_t *chRegNextThread(thread_t *tp);
+
+static inline void chMtxObjectInit(mutex_t *mp) { mp->locked = 0; }
+static inline void chMtxLock(mutex_t *mp) { mp->locked = 1; }
+static inline void chMtxUnlock(mutex_t *mp) { mp->locked = 0; }
+
+#endif /* SIM_CH_H */
@@ -0,0 +1,12 @@
+/*
+ * Host simulation, formatted output is the firmware's own chprintf.c
+ */
+#ifndef SIM_CHPRINTF_H
+#define SIM_CHPRINTF_H
+
+#include <stdarg.h>
+
+int chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap);
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...);
+
+#endif /* SIM_CHPRINTF_H */
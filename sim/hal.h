@@ -0,0 +1,223 @@
+/*
+ * Host simulation of the ChibiOS HAL and STM32F0 peripherals used by the tinySA firmware.
+ *
+ * Peripheral registers are plain RAM: GPIO reads return 0 (no lever pressed),
+ * the LCD SPI always reports an empty TX FIFO, DMA transfers complete at once
+ * and the SI4432/PE4302 bus is the RAM register model of __SI4432_BUS_MOCK__.
+ * The shell USB serial port is stdin/stdout.
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include "ch.h"
+#include "board.h"
+
+#define HAL_USE_SERIAL  FALSE
+
+#define __IO volatile
+#define __ASM asm
+#define __WFI()          do {} while (0)
+#define __disable_irq()  do {} while (0)
+#define __enable_irq()   do {} while (0)
+
+static inline uint32_t __REV16(uint32_t v) { return ((v & 0xFF00FF00U) >> 8) | ((v & 0x00FF00FFU) << 8); }
+static inline uint32_t __ROR(uint32_t v, uint32_t n) { n &= 31; return n ? (v >> n) | (v << (32 - n)) : v; }
+
+#define osalSysLock()   chSysLock()
+#define osalSysUnlock() chSysUnlock()
+
+#define STM32_SYSCLK    48000000
+
+/* SysTick, VAL counts down at STM32_SYSCLK from host time on every read */
+typedef struct { volatile uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+SysTick_Type *sim_systick(void);
+#define SysTick                    (sim_systick())
+#define SysTick_LOAD_RELOAD_Msk    0xFFFFFFUL
+#define SysTick_CTRL_CLKSOURCE_Msk 4
+#define SysTick_CTRL_ENABLE_Msk    1
+
+void NVIC_SystemReset(void);
+
+/* Clock trimming and the watchdog reset have no effect */
+typedef struct { volatile uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR; } RCC_TypeDef;
+extern RCC_TypeDef sim_rcc;
+#define RCC               (&sim_rcc)
+#define RCC_CR_HSION      (1U << 0)
+#define RCC_CR_HSITRIM_0  (1U << 3)
+#define RCC_CR_HSITRIM_1  (1U << 4)
+#define RCC_CR_HSITRIM_2  (1U << 5)
+#define RCC_CR_HSITRIM_3  (1U << 6)
+#define RCC_CR_HSITRIM_4  (1U << 7)
+#define RCC_CR_HSITRIM    (0x1FU << 3)
+#define RCC_CR_HSICAL     (0xFFU << 8)
+typedef struct { volatile uint32_t CR, CFR, SR; } WWDG_TypeDef;
+extern WWDG_TypeDef sim_wwdg;
+#define WWDG              (&sim_wwdg)
+#define rccEnableWWDG(lp) NVIC_SystemReset()
+
+/* GPIO */
+typedef struct { volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2], BRR; } GPIO_TypeDef;
+extern GPIO_TypeDef sim_gpio[6];
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOD (&sim_gpio[3])
+#define GPIOF (&sim_gpio[5])
+#define PAL_MODE_INPUT            0
+#define PAL_MODE_OUTPUT_PUSHPULL  1
+#define PAL_MODE_INPUT_ANALOG     3
+#define PAL_MODE_INPUT_PULLUP     4
+#define PAL_MODE_INPUT_PULLDOWN   5
+#define PAL_MODE_ALTERNATE(n)     (0x100 | (n))
+#define PAL_STM32_OSPEED_HIGHEST  0x20
+#define PAL_STM32_OTYPE_OPENDRAIN 0x40
+#define palSetPad(port, pad)       ((port)->ODR |=  (1U << (pad)))
+#define palClearPad(port, pad)     ((port)->ODR &= ~(1U << (pad)))
+#define palReadPad(port, pad)      (((port)->IDR >> (pad)) & 1U)
+#define palReadPort(port)          ((port)->IDR)
+#define palSetPort(port, bits)     ((port)->ODR |= (bits))
+#define palClearPort(port, bits)   ((port)->ODR &= ~(bits))
+#define palSetPadMode(port, pad, mode) ((void)(port), (void)(pad), (void)(mode))
+
+/* SPI */
+typedef struct { volatile uint32_t CR1, CR2, SR, DR, CRCPR, RXCRCR, TXCRCR, I2SCFGR, I2SPR; } SPI_TypeDef;
+extern SPI_TypeDef sim_spi[2];
+#define SPI1 (&sim_spi[0])
+#define SPI2 (&sim_spi[1])
+#define SPI_CR1_CPHA     (1U << 0)
+#define SPI_CR1_CPOL     (1U << 1)
+#define SPI_CR1_MSTR     (1U << 2)
+#define SPI_CR1_BR_0     (1U << 3)
+#define SPI_CR1_BR_1     (2U << 3)
+#define SPI_CR1_BR_2     (4U << 3)
+#define SPI_CR1_BR       (7U << 3)
+#define SPI_CR1_SPE      (1U << 6)
+#define SPI_CR1_SSI      (1U << 8)
+#define SPI_CR1_SSM      (1U << 9)
+#define SPI_CR1_BIDIOE   (1U << 14)
+#define SPI_CR1_BIDIMODE (1U << 15)
+#define SPI_CR2_RXDMAEN  (1U << 0)
+#define SPI_CR2_TXDMAEN  (1U << 1)
+#define SPI_CR2_DS       (15U << 8)
+#define SPI_CR2_FRXTH    (1U << 12)
+#define SPI_SR_RXNE      (1U << 0)
+#define SPI_SR_TXE       (1U << 1)
+#define SPI_SR_BSY       (1U << 7)
+#define rccEnableSPI1(lp) do {} while (0)
+#define rccEnableSPI2(lp) do {} while (0)
+#define rccResetSPI2()    do {} while (0)
+
+/* DMA, every transfer is complete as soon as it is started */
+typedef struct { volatile uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { DMA_Channel_TypeDef *channel; } stm32_dma_stream_t;
+extern stm32_dma_stream_t sim_dma_streams[7];
+#define STM32_DMA_STREAM_ID(dma, stream) ((((dma) - 1) * 7) + ((stream) - 1))
+#define STM32_DMA_STREAM(id)             (&sim_dma_streams[id])
+#define STM32_SPI_SPI1_RX_DMA_STREAM     STM32_DMA_STREAM_ID(1, 2)
+#define STM32_SPI_SPI1_TX_DMA_STREAM     STM32_DMA_STREAM_ID(1, 3)
+#define STM32_SPI_SPI2_RX_DMA_STREAM     STM32_DMA_STREAM_ID(1, 4)
+#define STM32_SPI_SPI2_TX_DMA_STREAM     STM32_DMA_STREAM_ID(1, 5)
+#define SPI1_RX_DMA_CHANNEL              0
+#define SPI1_TX_DMA_CHANNEL              0
+#define STM32_SPI_SPI1_DMA_PRIORITY      1
+#define STM32_SPI_SPI2_DMA_PRIORITY      1
+#define STM32_SPI_SPI1_IRQ_PRIORITY      2
+#define STM32_SPI_SPI2_IRQ_PRIORITY      2
+#define STM32_DMA_CR_EN          (1U << 0)
+#define STM32_DMA_CR_TCIE        (1U << 1)
+#define STM32_DMA_CR_DIR_P2M     0
+#define STM32_DMA_CR_DIR_M2P     (1U << 4)
+#define STM32_DMA_CR_MINC        (1U << 7)
+#define STM32_DMA_CR_PSIZE_BYTE  0
+#define STM32_DMA_CR_PSIZE_HWORD (1U << 8)
+#define STM32_DMA_CR_MSIZE_BYTE  0
+#define STM32_DMA_CR_MSIZE_HWORD (1U << 10)
+#define STM32_DMA_CR_PL(n)       ((uint32_t)(n) << 12)
+#define STM32_DMA_CR_CHSEL(n)    0
+#define dmaStreamAllocate(dmastp, prio, func, param) ((void)(dmastp))
+#define dmaStreamSetPeripheral(dmastp, addr)  ((dmastp)->channel->CPAR = (uint32_t)(uintptr_t)(addr))
+#define dmaStreamSetMemory0(dmastp, addr)     ((dmastp)->channel->CMAR = (uint32_t)(uintptr_t)(addr))
+#define dmaStreamSetTransactionSize(dmastp, size) ((dmastp)->channel->CNDTR = (uint32_t)(size))
+#define dmaStreamSetMode(dmastp, mode)        ((dmastp)->channel->CCR = (uint32_t)(mode))
+#define dmaStreamEnable(dmastp)               ((dmastp)->channel->CCR |= STM32_DMA_CR_EN)
+#define dmaStreamDisable(dmastp)              ((dmastp)->channel->CCR &= ~STM32_DMA_CR_EN)
+#define dmaStreamGetTransactionSize(dmastp)   ((size_t)((dmastp)->channel->CNDTR))
+#define dmaWaitCompletion(dmastp)             do { (dmastp)->channel->CNDTR = 0; dmaStreamDisable(dmastp); } while (0)
+
+/* Streams */
+#define _base_sequential_stream_methods                     \
+  size_t (*write)(void *instance, const uint8_t *bp, size_t n); \
+  size_t (*read)(void *instance, uint8_t *bp, size_t n);    \
+  msg_t (*put)(void *instance, uint8_t b);                  \
+  msg_t (*get)(void *instance);
+struct BaseSequentialStreamVMT { _base_sequential_stream_methods };
+typedef struct { const struct BaseSequentialStreamVMT *vmt; } BaseSequentialStream;
+#define streamWrite(ip, bp, n) ((ip)->vmt->write(ip, bp, n))
+#define streamRead(ip, bp, n)  ((ip)->vmt->read(ip, bp, n))
+#define streamPut(ip, b)       ((ip)->vmt->put(ip, b))
+#define streamGet(ip)          ((ip)->vmt->get(ip))
+
+/* USB CDC shell port on stdin/stdout */
+#define SERIAL_DEFAULT_BITRATE 38400
+#define USB_ACTIVE 4
+typedef struct { int state; } USBDriver;
+typedef struct { int dummy; } USBConfig;
+typedef struct { USBDriver *usbp; } SerialUSBConfig;
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  const SerialUSBConfig *config;
+} SerialUSBDriver;
+extern USBDriver USBD1;
+void sduObjectInit(SerialUSBDriver *sdup);
+void sduStart(SerialUSBDriver *sdup, const SerialUSBConfig *config);
+#define sduConfigureHookI(sdup) do {} while (0)
+#define sduDisconnectI(sdup)    do {} while (0)
+#define usbStart(usbp, cfg)     ((usbp)->state = USB_ACTIVE)
+#define usbConnectBus(usbp)     do {} while (0)
+#define usbDisconnectBus(usbp)  do {} while (0)
+#define usbGetDriverStateI(usbp) ((usbp)->state)
+
+/* DAC */
+typedef struct { uint32_t init; uint32_t datamode; } DACConfig;
+typedef struct { uint32_t value; } DACDriver;
+extern DACDriver DACD2;
+#define DAC_DHRM_12BIT_RIGHT 0
+#define dacStart(dacp, cfg)             ((void)(cfg))
+#define dacPutChannelX(dacp, chn, val)  ((dacp)->value = (val))
+
+/* GPT, polled delays spin on host time and let other threads run */
+typedef struct { uint32_t frequency; void *callback; uint32_t cr2, dier; } GPTConfig;
+typedef struct { uint32_t frequency; } GPTDriver;
+extern GPTDriver GPTD3, GPTD14;
+#define gptStart(gptp, cfg) ((gptp)->frequency = (cfg)->frequency)
+#define gptStartContinuous(gptp, interval) ((void)(interval))
+void gptPolledDelay(GPTDriver *gptp, uint32_t interval);
+
+/* ADC channel selection (adc.c is replaced by the simulation) */
+#define ADC_CHSELR_CHSEL4  (1U << 4)
+#define ADC_CHSELR_CHSEL6  (1U << 6)
+#define ADC_CHSELR_CHSEL7  (1U << 7)
+#define ADC_CHSELR_CHSEL9  (1U << 9)
+#define ADC_CHSELR_CHSEL16 (1U << 16)
+#define ADC_CHSELR_CHSEL17 (1U << 17)
+#define ADC_CHSELR_CHSEL18 (1U << 18)
+
+/* EXT (lever and touch interrupts never fire in the simulation) */
+typedef struct { int dummy; } EXTDriver;
+typedef uint32_t expchannel_t;
+typedef void (*extcallback_t)(EXTDriver *extp, expchannel_t channel);
+typedef struct { uint32_t mode; extcallback_t cb; } EXTChannelConfig;
+typedef struct { EXTChannelConfig channels[23]; } EXTConfig;
+extern EXTDriver EXTD1;
+#define extStart(extp, cfg) ((void)(cfg))
+#define EXT_CH_MODE_DISABLED     0
+#define EXT_CH_MODE_RISING_EDGE  1
+#define EXT_CH_MODE_FALLING_EDGE 2
+#define EXT_CH_MODE_BOTH_EDGES   3
+#define EXT_CH_MODE_AUTOSTART    4
+#define EXT_MODE_GPIOA           0
+#define EXT_MODE_GPIOB           1
+
+void halInit(void);
+
+#endif /* SIM_HAL_H */
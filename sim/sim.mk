@@ -0,0 +1,52 @@
+##############################################################################
+# Host native simulation build, no ChibiOS tree or ARM toolchain needed.
+#
+# The firmware sources are built with the host compiler against the kernel and
+# HAL stubs in sim/, with the simulated radio model and SI4432/PE4302 bus.
+# The shell runs on stdin/stdout, e.g.
+#   make sim && printf "bench 4\n" | build_sim/tinysa_sim
+#
+
+SIM_CC      ?= gcc
+SIM_BUILD    = build_sim
+SIM_TARGET   = $(SIM_BUILD)/tinysa_sim
+SIM_SRC      = main.c plot.c ui.c ili9341.c si4432.c chprintf.c \
+               numfont20x22.c Font5x7.c Font10x14.c Font7x13b.c \
+               sim/sim_port.c
+SIM_OBJS     = $(addprefix $(SIM_BUILD)/,$(notdir $(SIM_SRC:.c=.o)))
+SIM_CFLAGS   = -fno-pie -fno-strict-aliasing -O2 -g $(SIM_EXTRA) -std=gnu11 -fsingle-precision-constant -Wall -Wno-unused-function \
+               -Isim -I. -INANOVNA_STM32_F072 \
+               -D__SIMULATION__ -D__SI4432_BUS_MOCK__ -D__USE_DISPLAY_DMA_RX__ \
+               -DVERSION=\"tinySA_sim\"
+SIM_LIBS     = -lm -lpthread
+
+vpath %.c . sim
+
+.PHONY: sim sim-check sim-clean
+
+sim: $(SIM_TARGET)
+
+# Fixed point trace averaging against the float path, also prints the per point cost on the host
+sim-check: $(SIM_BUILD)/average_check
+	$(SIM_BUILD)/average_check
+
+$(SIM_BUILD)/average_check: sim/average_check.c nanovna.h | $(SIM_BUILD)
+	$(SIM_CC) $(SIM_CFLAGS) -no-pie -o $@ $< -lm
+
+# Static data below 4GB, the firmware keeps pointers in uint32_t in a few places
+$(SIM_TARGET): $(SIM_OBJS)
+	$(SIM_CC) -no-pie -o $@ $^ $(SIM_LIBS)
+
+$(SIM_BUILD)/%.o: %.c $(wildcard *.h sim/*.h) | $(SIM_BUILD)
+	$(SIM_CC) $(SIM_CFLAGS) -c $< -o $@
+
+# main.c includes the sweep engine and shell commands
+$(SIM_BUILD)/main.o: sa_core.c sa_cmd.c
+$(SIM_BUILD)/ui.o: ui_sa.c
+$(SIM_BUILD)/plot.o: waterfall.c
+
+$(SIM_BUILD):
+	mkdir -p $@
+
+sim-clean:
+	rm -rf $(SIM_BUILD)
@@ -0,0 +1,359 @@
+/*
+ * Host simulation port: kernel, peripherals, flash and ADC of the tinySA firmware on Linux.
+ *
+ * The firmware's own main() runs unchanged. The shell reads commands from
+ * stdin (one per line) and writes replies to stdout, the process exits at end
+ * of input, after the last command has completed.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include "ch.h"
+#include "hal.h"
+#include "nanovna.h"
+#include "usbcfg.h"
+
+//*****************************************************
+// Kernel
+//*****************************************************
+static pthread_mutex_t sim_kernel = PTHREAD_MUTEX_INITIALIZER;   // Owned by the running thread
+static pthread_cond_t  sim_wakeup = PTHREAD_COND_INITIALIZER;    // Broadcast on every resume
+static __thread thread_t *sim_self;
+static uint8_t sim_main_stack[4];    // Never filled, "threads" reports no stack use
+static thread_t sim_main_thread = {.wabase = sim_main_stack, .name = "main", .prio = NORMALPRIO, .refs = 1};
+static thread_t *sim_threads = &sim_main_thread;
+static struct timespec sim_epoch;
+
+static uint64_t sim_time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)(ts.tv_sec - sim_epoch.tv_sec) * 1000000000U + ts.tv_nsec - sim_epoch.tv_nsec;
+}
+
+static void sim_deadline(struct timespec *ts, uint64_t ns)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ns += ts->tv_nsec;
+  ts->tv_sec += ns / 1000000000U;
+  ts->tv_nsec = ns % 1000000000U;
+}
+
+void chSysInit(void)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sim_wakeup, &attr);
+  clock_gettime(CLOCK_MONOTONIC, &sim_epoch);
+  pthread_mutex_lock(&sim_kernel);
+  sim_self = &sim_main_thread;
+}
+
+systime_t chVTGetSystemTimeX(void)
+{
+  return (systime_t)(sim_time_ns() / (1000000000U / CH_CFG_ST_FREQUENCY));
+}
+
+void chThdSleep(sysinterval_t time)
+{
+  struct timespec ts;
+  ts.tv_sec  = time / CH_CFG_ST_FREQUENCY;
+  ts.tv_nsec = (time % CH_CFG_ST_FREQUENCY) * (1000000000U / CH_CFG_ST_FREQUENCY);
+  pthread_mutex_unlock(&sim_kernel);
+  if (time)
+    nanosleep(&ts, NULL);
+  else
+    sched_yield();
+  pthread_mutex_lock(&sim_kernel);
+}
+
+static void *sim_thread_entry(void *arg)
+{
+  thread_t *tp = arg;
+  pthread_mutex_lock(&sim_kernel);
+  sim_self = tp;
+  tp->func(tp->arg);
+  pthread_mutex_unlock(&sim_kernel);
+  return NULL;
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg)
+{
+  thread_t *tp = calloc(1, sizeof(thread_t));
+  pthread_t pt;
+  tp->wabase = wsp;
+  tp->ctx.sp = (uint8_t *)wsp + size;
+  tp->prio = prio;
+  tp->refs = 1;
+  tp->func = pf;
+  tp->arg = arg;
+  tp->next = sim_threads;
+  sim_threads = tp;
+  // Starts running when the creator blocks, as a lower priority thread would
+  if (pthread_create(&pt, NULL, sim_thread_entry, tp) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+  pthread_detach(pt);
+  return tp;
+}
+
+thread_t *chThdGetSelfX(void)
+{
+  return sim_self;
+}
+
+msg_t chThdWait(thread_t *tp)
+{
+  (void)tp;
+  for (;;)
+    chThdSleep(TIME_MS2I(1000));
+  return MSG_OK;
+}
+
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, sysinterval_t timeout)
+{
+  thread_t *tp = sim_self;
+  struct timespec ts;
+  if (timeout == TIME_IMMEDIATE)
+    return MSG_TIMEOUT;
+  if (timeout != TIME_INFINITE)
+    sim_deadline(&ts, (uint64_t)timeout * (1000000000U / CH_CFG_ST_FREQUENCY));
+  tp->woken = false;
+  *trp = tp;
+  while (!tp->woken) {
+    if (timeout == TIME_INFINITE)
+      pthread_cond_wait(&sim_wakeup, &sim_kernel);
+    else if (pthread_cond_timedwait(&sim_wakeup, &sim_kernel, &ts) == ETIMEDOUT && !tp->woken) {
+      *trp = NULL;
+      return MSG_TIMEOUT;
+    }
+  }
+  return tp->rdymsg;
+}
+
+msg_t chThdSuspendS(thread_reference_t *trp)
+{
+  return chThdSuspendTimeoutS(trp, TIME_INFINITE);
+}
+
+void chThdResumeI(thread_reference_t *trp, msg_t msg)
+{
+  thread_t *tp = *trp;
+  if (tp == NULL)
+    return;
+  *trp = NULL;
+  tp->rdymsg = msg;
+  tp->woken = true;
+  pthread_cond_broadcast(&sim_wakeup);
+}
+
+void chRegSetThreadName(const char *name)
+{
+  sim_self->name = name;
+}
+
+thread_t *chRegFirstThread(void)
+{
+  return sim_threads;
+}
+
+thread_t *chRegNextThread(thread_t *tp)
+{
+  return tp->next;
+}
+
+//*****************************************************
+// Peripherals
+//*****************************************************
+RCC_TypeDef sim_rcc;
+WWDG_TypeDef sim_wwdg;
+GPIO_TypeDef sim_gpio[6];
+SPI_TypeDef sim_spi[2] = {{.SR = SPI_SR_TXE}, {.SR = SPI_SR_TXE}};
+static DMA_Channel_TypeDef sim_dma_channels[7];
+stm32_dma_stream_t sim_dma_streams[7] = {
+  {&sim_dma_channels[0]}, {&sim_dma_channels[1]}, {&sim_dma_channels[2]}, {&sim_dma_channels[3]},
+  {&sim_dma_channels[4]}, {&sim_dma_channels[5]}, {&sim_dma_channels[6]},
+};
+DACDriver DACD2;
+GPTDriver GPTD3, GPTD14;
+EXTDriver EXTD1;
+USBDriver USBD1;
+
+void halInit(void)
+{
+}
+
+SysTick_Type *sim_systick(void)
+{
+  static SysTick_Type systick;
+  uint64_t cycles = sim_time_ns() * (STM32_SYSCLK / 1000000) / 1000;
+  systick.VAL = SysTick_LOAD_RELOAD_Msk - (uint32_t)(cycles & SysTick_LOAD_RELOAD_Msk);
+  return &systick;
+}
+
+void NVIC_SystemReset(void)
+{
+  fflush(stdout);
+  exit(0);
+}
+
+// Busy wait like the hardware timer, but let the other threads run meanwhile
+void gptPolledDelay(GPTDriver *gptp, uint32_t interval)
+{
+  uint64_t end = sim_time_ns() + (uint64_t)interval * 1000000000U / (gptp->frequency ? gptp->frequency : 1000000);
+  pthread_mutex_unlock(&sim_kernel);
+  while (sim_time_ns() < end)
+    sched_yield();
+  pthread_mutex_lock(&sim_kernel);
+}
+
+//*****************************************************
+// Shell port (USB CDC) on stdin/stdout
+//*****************************************************
+static size_t sdu_write(void *ip, const uint8_t *bp, size_t n)
+{
+  (void)ip;
+  fwrite(bp, 1, n, stdout);
+  fflush(stdout);
+  return n;
+}
+
+// Lines end with '\r' for the shell, end of input ends the simulation
+static size_t sdu_read(void *ip, uint8_t *bp, size_t n)
+{
+  (void)ip;
+  size_t i;
+  pthread_mutex_unlock(&sim_kernel);
+  for (i = 0; i < n; i++) {
+    int c = getchar();
+    if (c == EOF) {
+      fflush(stdout);
+      exit(0);
+    }
+    bp[i] = c == '\n' ? '\r' : (uint8_t)c;
+  }
+  pthread_mutex_lock(&sim_kernel);
+  return n;
+}
+
+static msg_t sdu_put(void *ip, uint8_t b)
+{
+  sdu_write(ip, &b, 1);
+  return MSG_OK;
+}
+
+static msg_t sdu_get(void *ip)
+{
+  uint8_t b;
+  sdu_read(ip, &b, 1);
+  return b;
+}
+
+static const struct BaseSequentialStreamVMT sdu_vmt = {sdu_write, sdu_read, sdu_put, sdu_get};
+const USBConfig usbcfg;
+SerialUSBConfig serusbcfg = {&USBD1};
+SerialUSBDriver SDU1;
+
+void sduObjectInit(SerialUSBDriver *sdup)
+{
+  sdup->vmt = &sdu_vmt;
+}
+
+void sduStart(SerialUSBDriver *sdup, const SerialUSBConfig *config)
+{
+  sdup->config = config;
+}
+
+//*****************************************************
+// Flash, saved config and settings live in RAM for the run
+//*****************************************************
+static config_t  sim_config;
+static bool      sim_config_saved;
+static setting_t sim_setting[SAVEAREA_MAX];
+static float     sim_stored_t[SAVEAREA_MAX][sizeof(stored_t) / sizeof(float)];
+static bool      sim_setting_saved[SAVEAREA_MAX];
+
+int config_save(void)
+{
+  config.magic = CONFIG_MAGIC;
+  sim_config = config;
+  sim_config_saved = true;
+  return 0;
+}
+
+int config_recall(void)
+{
+  if (!sim_config_saved)
+    return -1;
+  config = sim_config;
+  return 0;
+}
+
+int caldata_save(uint16_t id)
+{
+  if (id >= SAVEAREA_MAX)
+    return -1;
+  setting.magic = CONFIG_MAGIC;
+  sim_setting[id] = setting;
+  memcpy(sim_stored_t[id], stored_t, sizeof(stored_t));
+  sim_setting_saved[id] = true;
+  return 0;
+}
+
+int caldata_recall(uint16_t id)
+{
+  if (id >= SAVEAREA_MAX || !sim_setting_saved[id])
+    return -1;
+  setting = sim_setting[id];
+  memcpy(stored_t, sim_stored_t[id], sizeof(stored_t));
+  update_min_max_freq();
+  update_frequencies();
+  set_scale(setting.scale);
+  set_reflevel(setting.reflevel);
+  return 0;
+}
+
+void clear_all_config_prop_data(void)
+{
+  sim_config_saved = false;
+  memset(sim_setting_saved, 0, sizeof sim_setting_saved);
+}
+
+//*****************************************************
+// ADC, no touch and a full battery
+//*****************************************************
+void adc_init(void)
+{
+}
+
+uint16_t adc_single_read(uint32_t chsel)
+{
+  (void)chsel;
+  return 0;
+}
+
+int16_t adc_vbat_read(void)
+{
+  return 4100;
+}
+
+void adc_start_analog_watchdogd(uint32_t chsel)
+{
+  (void)chsel;
+}
+
+void adc_stop(void)
+{
+}
+
+void adc_interrupt(void)
+{
+}
@@ -2965,6 +2965,9 @@ static void extcb1(EXTDriver *extp, expchannel_t channel)
   (void)extp;
   (void)channel;
   operation_requested|=OP_LEVER;
+  chSysLockFromISR();
+  wakeup_sweep_threadI();
+  chSysUnlockFromISR();
   // cur_button = READ_PORT() & BUTTON_MASK;
 }
 
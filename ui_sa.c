@@ -470,7 +470,9 @@ static const menuitem_t  menu_modulation[];
 static const menuitem_t  menu_top[];
 static const menuitem_t  menu_reffer[];
 static const menuitem_t  menu_modulation[];
+#if 0
 static const menuitem_t  menu_drive_wide[];
+#endif
 static const menuitem_t  menu_sweep[];
 #ifdef __ULTRA__
 static const menuitem_t  menu_tophigh[];
@@ -576,7 +578,6 @@ static UI_FUNCTION_ADV_CALLBACK(menu_store_preset_acb)
 }
 
 
-extern int dirty;
 UI_FUNCTION_CALLBACK(menu_autosettings_cb)
 {
   (void)item;
@@ -1751,6 +1752,9 @@ static const menuitem_t menu_sweep_speed[] =
  { MT_KEYPAD,           KM_SWEEP_TIME, "SWEEP\nTIME",     "0..600s, 0=disable"},       // This must be item 3 to match highlighting
  { MT_SUBMENU,          0,             "SWEEP\nPOINTS",   menu_sweep_points},
  { MT_KEYPAD   | MT_LOW,KM_FAST_SPEEDUP,"FAST\nSPEEDUP",  "2..20, 0=disable"},
+#ifdef __ADAPTIVE_SETTLE__
+ { MT_ADV_CALLBACK,     SD_ADAPTIVE,   "ADAPTIVE",        menu_scanning_speed_acb},
+#endif
  { MT_CANCEL,   0,             S_LARROW" BACK", NULL },
  { MT_NONE,     0, NULL, NULL } // sentinel
 };
@@ -2366,8 +2370,8 @@ int invoke_quick_menu(int y)
   int i=0;
   while (i < max_quick_menu) {
     if (y < quick_menu_y[i] && quick_menu[i] != NULL) {
-      if ((uint32_t)quick_menu[i] < KM_NONE) {
-        ui_mode_keypad((int)quick_menu[i]);
+      if ((uintptr_t)quick_menu[i] < KM_NONE) {
+        ui_mode_keypad((int)(uintptr_t)quick_menu[i]);
         ui_process_keypad();
       } else {
         selection = -1;
@@ -2484,6 +2488,12 @@ redraw_cal_status:
     ili9341_drawstring("PAUSED", x, y);
     y += YSTEP + YSTEP/2 ;
   }
+  if (is_staged()) {
+    color = LCD_BRIGHT_COLOR_GREEN;
+    ili9341_set_foreground(color);
+    ili9341_drawstring("STAGED", x, y);
+    y += YSTEP + YSTEP/2 ;
+  }
   if (setting.trigger == T_SINGLE || setting.trigger == T_NORMAL ) {
     color = LCD_BRIGHT_COLOR_GREEN;
     ili9341_set_foreground(color);
@@ -2583,6 +2593,10 @@ redraw_cal_status:
     buf[0] = 'P';
   else if (setting.step_delay_mode == SD_FAST)
     buf[0] = 'F';
+#ifdef __ADAPTIVE_SETTLE__
+  else if (setting.step_delay_mode == SD_ADAPTIVE)
+    buf[0] = 'A';
+#endif
   else
     strcpy(&buf[0],"Scan:");
   ili9341_drawstring(buf, x, y);